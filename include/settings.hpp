@@ -14,9 +14,63 @@
 enum inputtype{
 	CAM=0,
 	VIDEO,
-	IMAGE
+	IMAGE,
+	REPLAY,
+	BATCH,
+	VERIFY,
+	MULTI,
+	SERVER,
+	CLIENT,
+	SHM,
+	PIPE,
+	AUTOTUNE
 };
 
+/**
+ * @brief MULTI 模式下的一路输入
+ * 	source 	-> 摄像头编号 ("0"), URL (rtsp://...) 或视频文件
+ * 	output 	-> 画好的视频 (空 = 不输出)
+ * 	priority 	-> 权重, 推理能力按权重分给有帧等待的各路输入
+ * 	fpsCap 	-> 每秒最多推理的帧数 (0 = 不限)
+ */
+struct StreamSettings{
+	StreamSettings():priority(1),fpsCap(0){}
+	void write(cv::FileStorage& fs) const {
+		fs << "{";
+		fs << "name" << name;
+		fs << "source" << source;
+		fs << "output" << output;
+		fs << "priority" << priority;
+		fs << "fpsCap" << fpsCap;
+		fs << "}";
+	}
+	void read(const cv::FileNode& node){
+		node["name"] >> name;
+		node["source"] >> source;
+		node["output"] >> output;
+		if(!node["priority"].empty()) node["priority"] >> priority;
+		node["fpsCap"] >> fpsCap;
+	}
+
+	std::string name; 	// label of the metrics and logs (default stream<i>)
+	std::string source;
+	std::string output;
+	double priority;
+	double fpsCap;
+};
+
+static inline void read(const cv::FileNode& node, StreamSettings& s, const StreamSettings& default_value = StreamSettings()){
+	if(node.empty()){
+		s = default_value;
+	} else {
+		s.read(node);
+	}
+}
+
+static inline void write(cv::FileStorage& fs, const std::string&, const StreamSettings& s){
+	s.write(fs);
+}
+
 class Settings{
 	public:
 		// Default is an Error Input
@@ -25,12 +79,69 @@ class Settings{
 			fs << "{";
 			fs << "modelTxt" << modelTxt;
 			fs << "modelBin" << modelBin;
+			fs << "modelCache" << modelCache;
+			fs << "warmup" << warmup;
+			fs << "warmupWidth" << warmupWidth;
+			fs << "warmupHeight" << warmupHeight;
+			fs << "autotune" << autotune;
+			fs << "autotuneCache" << autotuneCache;
+			fs << "autotuneRuns" << autotuneRuns;
 			fs << "dataset" << dataset;
 
+			fs << "detectHands" << detectHands;
+			fs << "handModelTxt" << handModelTxt;
+			fs << "handModelBin" << handModelBin;
+			fs << "handInputSize" << handInputSize;
+			fs << "handThresh" << handThresh;
+
 			fs << "inputType" << inputType;
 			fs << "imageFile" << imageFile;
 			fs << "videoFile" << videoFile;
 			fs << "outputPath" << outputPath;
+			fs << "recordFile" << recordFile;
+			fs << "replayFile" << replayFile;
+
+			fs << "verifyFrames" << verifyFrames;
+			fs << "verifyTolerance" << verifyTolerance;
+			fs << "verifySeed" << verifySeed;
+
+			fs << "streams" << streams;
+			fs << "streamNets" << streamNets;
+			fs << "streamQueue" << streamQueue;
+			fs << "maxBatch" << maxBatch;
+			fs << "batchWaitMs" << batchWaitMs;
+
+			fs << "socketPath" << socketPath;
+			fs << "serverNets" << serverNets;
+			fs << "clientRequests" << clientRequests;
+
+			fs << "shmName" << shmName;
+			fs << "shmWidth" << shmWidth;
+			fs << "shmHeight" << shmHeight;
+			fs << "shmSlots" << shmSlots;
+
+			fs << "resultShmName" << resultShmName;
+			fs << "resultShmSlots" << resultShmSlots;
+			fs << "resultShmMaxPeople" << resultShmMaxPeople;
+			fs << "resultShmReaders" << resultShmReaders;
+			fs << "resultShmFrame" << resultShmFrame;
+
+			fs << "pipeWidth" << pipeWidth;
+			fs << "pipeHeight" << pipeHeight;
+			fs << "pipeFps" << pipeFps;
+			fs << "pipeQueue" << pipeQueue;
+			fs << "pipeOutput" << pipeOutput;
+
+			fs << "startTime" << startTime;
+			fs << "endTime" << endTime;
+			fs << "frameStride" << frameStride;
+			fs << "keypointsPath" << keypointsPath;
+			fs << "interpolateKeypoints" << interpolateKeypoints;
+
+			fs << "imageDir" << imageDir;
+			fs << "batchReaders" << batchReaders;
+			fs << "batchNets" << batchNets;
+			fs << "batchWriters" << batchWriters;
 
 			fs << "W_in" << W_in;
 			fs << "H_in" << H_in;
@@ -38,8 +149,37 @@ class Settings{
 			fs << "thresh" << thresh;
 			fs << "scale" << scale;
 
+			fs << "twoPass" << twoPass;
+			fs << "coarseH" << coarseH;
+			fs << "roiThresh" << roiThresh;
+			fs << "roiPadding" << roiPadding;
+			fs << "roiBatch" << roiBatch;
+
+			fs << "tileSize" << tileSize;
+			fs << "tileOverlap" << tileOverlap;
+
+			fs << "heatmapPrecision" << heatmapPrecision;
+			fs << "singlePerson" << singlePerson;
+
+			fs << "renderInPlace" << renderInPlace;
+			fs << "renderFast" << renderFast;
+			fs << "previewWidth" << previewWidth;
+
 			fs << "logPath" << logPath;
+			fs << "logVerbosity" << logVerbosity;
+			fs << "tracePath" << tracePath;
+			fs << "traceCapacity" << traceCapacity;
+			fs << "metricsPort" << metricsPort;
+			fs << "metricsFile" << metricsFile;
+			fs << "metricsInterval" << metricsInterval;
+			fs << "layerProfile" << layerProfile;
 			fs << "device" << device;
+
+			fs << "cpuBudget" << cpuBudget;
+			fs << "inferThreads" << inferThreads;
+			fs << "postThreads" << postThreads;
+			fs << "ioThreads" << ioThreads;
+			fs << "pinThreads" << pinThreads;
 			fs << "}";
 		}
 		void read(const cv::FileNode& node){
@@ -48,10 +188,67 @@ class Settings{
 			node["modelTxt"] >> modelTxt;
 			node["modelBin"] >> modelBin;
 
+			node["detectHands"] >> detectHands;
+			node["handModelTxt"] >> handModelTxt;
+			node["handModelBin"] >> handModelBin;
+			node["handInputSize"] >> handInputSize;
+			node["handThresh"] >> handThresh;
+			node["modelCache"] >> modelCache;
+			node["warmup"] >> warmup;
+			node["warmupWidth"] >> warmupWidth;
+			node["warmupHeight"] >> warmupHeight;
+			node["autotune"] >> autotune;
+			node["autotuneCache"] >> autotuneCache;
+			node["autotuneRuns"] >> autotuneRuns;
+
 			node["inputType"] >> inputType;
 			node["imageFile"] >> imageFile;
 			node["videoFile"] >> videoFile;
 			node["outputPath"] >> outputPath;
+			node["recordFile"] >> recordFile;
+			node["replayFile"] >> replayFile;
+
+			node["verifyFrames"] >> verifyFrames;
+			node["verifyTolerance"] >> verifyTolerance;
+			node["verifySeed"] >> verifySeed;
+
+			node["streams"] >> streams;
+			node["streamNets"] >> streamNets;
+			node["streamQueue"] >> streamQueue;
+			node["maxBatch"] >> maxBatch;
+			node["batchWaitMs"] >> batchWaitMs;
+
+			node["socketPath"] >> socketPath;
+			node["serverNets"] >> serverNets;
+			node["clientRequests"] >> clientRequests;
+
+			node["shmName"] >> shmName;
+			node["shmWidth"] >> shmWidth;
+			node["shmHeight"] >> shmHeight;
+			node["shmSlots"] >> shmSlots;
+
+			node["resultShmName"] >> resultShmName;
+			node["resultShmSlots"] >> resultShmSlots;
+			node["resultShmMaxPeople"] >> resultShmMaxPeople;
+			node["resultShmReaders"] >> resultShmReaders;
+			node["resultShmFrame"] >> resultShmFrame;
+
+			node["pipeWidth"] >> pipeWidth;
+			node["pipeHeight"] >> pipeHeight;
+			node["pipeFps"] >> pipeFps;
+			node["pipeQueue"] >> pipeQueue;
+			node["pipeOutput"] >> pipeOutput;
+
+			node["startTime"] >> startTime;
+			node["endTime"] >> endTime;
+			node["frameStride"] >> frameStride;
+			node["keypointsPath"] >> keypointsPath;
+			node["interpolateKeypoints"] >> interpolateKeypoints;
+
+			node["imageDir"] >> imageDir;
+			node["batchReaders"] >> batchReaders;
+			node["batchNets"] >> batchNets;
+			node["batchWriters"] >> batchWriters;
 
 			node["W_in"] >> W_in;
 			node["H_in"] >> H_in;
@@ -59,10 +256,44 @@ class Settings{
 			node["thresh"] >> thresh;
 			node["scale"] >> scale;
 
+			node["twoPass"] >> twoPass;
+			node["coarseH"] >> coarseH;
+			node["roiThresh"] >> roiThresh;
+			node["roiPadding"] >> roiPadding;
+			node["roiBatch"] >> roiBatch;
+
+			node["tileSize"] >> tileSize;
+			node["tileOverlap"] >> tileOverlap;
+
+			node["heatmapPrecision"] >> heatmapPrecision;
+			node["singlePerson"] >> singlePerson;
+
+			node["renderInPlace"] >> renderInPlace;
+			node["renderFast"] >> renderFast;
+			node["previewWidth"] >> previewWidth;
+
 			node["logPath"] >> logPath;
+			/* Verbosity 1 logs every stage of every frame, keep it out of the hot path when tracing */
+			if(node["logVerbosity"].empty()){
+				logVerbosity = loguru::Verbosity_MAX;
+			}else{
+				node["logVerbosity"] >> logVerbosity;
+			}
+			node["tracePath"] >> tracePath;
+			node["traceCapacity"] >> traceCapacity;
+			node["metricsPort"] >> metricsPort;
+			node["metricsFile"] >> metricsFile;
+			node["metricsInterval"] >> metricsInterval;
+			node["layerProfile"] >> layerProfile;
 
 			node["device"] >> device;
 
+			node["cpuBudget"] >> cpuBudget;
+			node["inferThreads"] >> inferThreads;
+			node["postThreads"] >> postThreads;
+			node["ioThreads"] >> ioThreads;
+			node["pinThreads"] >> pinThreads;
+
 			validate();
 		}
 
@@ -71,15 +302,87 @@ class Settings{
 			if(logPath.empty()){
 				LOG_F(INFO, "No Log Path Specified, Log to stderr Only");
 			}else{
-				loguru::add_file(logPath.c_str(), loguru::Truncate, loguru::Verbosity_MAX);
+				loguru::add_file(logPath.c_str(), loguru::Truncate, logVerbosity);
 				LOG_F(INFO, "Log to File '%s'",logPath.c_str());
 			}
-			if(modelTxt.empty() || modelBin.empty() || dataset.empty()){
+			/* Replay / verify read recorded or synthetic network outputs, only the topology (dataset) is needed */
+			bool needModel = inputType != "REPLAY" && inputType != "VERIFY" && inputType != "CLIENT";
+			if(dataset.empty() || (needModel && (modelTxt.empty() || modelBin.empty()))){
 				LOG_F(ERROR, "Model Configuration Crashed");
 				goodInput = false;
 			}else{
 				LOG_F(INFO, "model type: %s",dataset.c_str());
 			}
+			/* Warm up with a square frame unless the expected frame size is given */
+			if(warmupWidth <= 0 || warmupHeight <= 0){
+				warmupWidth = W_in;
+				warmupHeight = H_in;
+			}
+			if(autotuneCache.empty()) autotuneCache = "./autotune.yml";
+			if(autotuneRuns <= 0) autotuneRuns = 5;
+			/* Filled by autotuneNet, -1 = backend / target from device */
+			dnnBackend = -1;
+			dnnTarget = -1;
+			dnnFusion = true;
+			dnnWinograd = true;
+			if(traceCapacity <= 0) traceCapacity = 1 << 16;
+			if(metricsInterval <= 0) metricsInterval = 10;
+			if(detectHands && (handModelTxt.empty() || handModelBin.empty())){
+				LOG_F(ERROR, "detectHands but handModelTxt '%s' or handModelBin '%s' is invalid", handModelTxt.c_str(), handModelBin.c_str());
+				goodInput = false;
+			}
+			if(handInputSize <= 0) handInputSize = 368;
+			if(handThresh <= 0) handThresh = 0.1;
+			if(coarseH <= 0) coarseH = H_in / 2;
+			if(roiThresh <= 0) roiThresh = 0.3;
+			if(roiPadding <= 0) roiPadding = 0.25;
+			if(roiBatch <= 0) roiBatch = 8;
+			if(tileSize > 0){
+				if(tileOverlap <= 0) tileOverlap = tileSize / 4;
+				if(tileOverlap >= tileSize){
+					LOG_F(ERROR, "tileOverlap %d must be smaller than tileSize %d", tileOverlap, tileSize);
+					goodInput = false;
+				}
+			}
+			if(!resultShmName.empty()){
+				if(resultShmName[0] != '/'){
+					LOG_F(ERROR, "resultShmName '%s' is invalid (e.g. /openpose-results)", resultShmName.c_str());
+					goodInput = false;
+				}
+				if(resultShmSlots <= 0) resultShmSlots = 8;
+				if(resultShmMaxPeople <= 0) resultShmMaxPeople = 32;
+				if(resultShmReaders <= 0) resultShmReaders = 8;
+			}
+			if(pipeOutput.empty()) pipeOutput = "NONE";
+			if(pipeOutput != "NONE" && pipeOutput != "FRAMES" && pipeOutput != "KEYPOINTS"){
+				LOG_F(ERROR, "pipeOutput '%s' Not Supported (valid: NONE, FRAMES, KEYPOINTS)", pipeOutput.c_str());
+				goodInput = false;
+			}
+			if(pipeQueue <= 0) pipeQueue = 4;
+			if(frameStride <= 0) frameStride = 1;
+			if(startTime < 0 || (endTime > 0 && endTime <= startTime)){
+				LOG_F(ERROR, "startTime %.3f / endTime %.3f is invalid", startTime, endTime);
+				goodInput = false;
+			}
+			if(heatmapPrecision.empty()) heatmapPrecision = "FP32";
+			if(heatmapPrecision != "FP32" && heatmapPrecision != "FP16" && heatmapPrecision != "U8"){
+				LOG_F(ERROR, "heatmapPrecision '%s' Not Supported (valid: FP32, FP16, U8)", heatmapPrecision.c_str());
+				goodInput = false;
+			}
+			if(singlePerson && (twoPass || tileSize > 0)){
+				LOG_F(WARNING, "singlePerson: twoPass / tileSize ignored, the whole frame is one forward");
+				twoPass = false;
+				tileSize = 0;
+			}
+			if(!recordFile.empty() && (twoPass || tileSize > 0)){
+				/* A coarse pass, ROI canvas or tile is not a frame, REPLAY would post-process it as one */
+				LOG_F(WARNING, "recordFile: only single-pass frames are recorded, twoPass / tiled frames are skipped");
+			}
+			if(singlePerson && inputType=="VERIFY"){
+				/* VERIFY checks the multi-person fast paths against the reference */
+				LOG_F(WARNING, "singlePerson ignored in VERIFY");
+				singlePerson = false;
+			}
 			if(device!="CPU" && device != "GPU"){
 				LOG_F(ERROR, "Device '%s' Not Supported",device.c_str());
 				goodInput = false;
@@ -87,8 +390,10 @@ class Settings{
 			/* Parameters Reference: 
 			 * https://github.com/CMU-Perceptual-Computing-Lab/openpose/blob/master/src/openpose/pose/poseParameters.cpp 
 			 */
+			backgroundIdx = -1;
 			if(dataset=="COCO"){
 				nPoints = 18;
+				backgroundIdx = 18;
 				keypointsMapping = {
 					"Nose", "Neck",
 					"R-Sho", "R-Elb", "R-Wr",
@@ -110,8 +415,29 @@ class Settings{
 					{1,0}, {0,14}, {14,16}, {0,15}, {15,17}, {2,17},
 					{5,16}
 				};
+			}else if(dataset=="MPI"){
+				/* pose_deploy_linevec(_faster_4_stages): 15 heatMaps + background, then 14 PAF pairs */
+				nPoints = 15;
+				backgroundIdx = 15;
+				keypointsMapping = {
+					"Head", "Neck",
+					"R-Sho", "R-Elb", "R-Wr",
+					"L-Sho", "L-Elb", "L-Wr",
+					"R-Hip", "R-Knee", "R-Ank",
+					"L-Hip", "L-Knee", "L-Ank",
+					"Chest"
+				};
+				mapIdx = {
+					{16,17}, {18,19}, {20,21}, {22,23}, {24,25}, {26,27}, {28,29},
+					{30,31}, {32,33}, {34,35}, {36,37}, {38,39}, {40,41}, {42,43}
+				};
+				posePairs = {
+					{0,1}, {1,2}, {2,3}, {3,4}, {1,5}, {5,6}, {6,7},
+					{1,14}, {14,8}, {8,9}, {9,10}, {14,11}, {11,12}, {12,13}
+				};
 			}else if(dataset=="BODY_25"){
 				nPoints = 25;
+				backgroundIdx = 25;
 				keypointsMapping = {
 					"Nose", "Neck", 
 					"RShoulder", "RElbow","RWrist",
@@ -145,7 +471,8 @@ class Settings{
 					{11,24},
 				};
 			}else if(dataset=="HAND"){
-				LOG_F(WARNING, "Hand Model is yet finished, Try other models");
+				/* Running the hand net on the whole frame is far too slow, hands are cut from the body result instead */
+				LOG_F(ERROR, "HAND is not a body model, use a body dataset with detectHands, handModelTxt and handModelBin");
 				/* Reference: OpenPose PoseParameters */
 				/* https://github.com/CMU-Perceptual-Computing-Lab/openpose/blob/master/src/openpose/pose/poseParameters.cpp#L175 */
 				nPoints = 42;
@@ -204,8 +531,82 @@ class Settings{
 					goodInput = false;
 				}
 				type=IMAGE;
+			}else if(inputType=="REPLAY"){
+				if(replayFile.empty()){
+					LOG_F(ERROR, "Input Type '%s' but replayFile '%s' is invalid", inputType.c_str(), replayFile.c_str());
+					goodInput = false;
+				}
+				type=REPLAY;
+			}else if(inputType=="BATCH"){
+				if(imageDir.empty() || outputPath.empty()){
+					LOG_F(ERROR, "Input Type '%s' but imageDir '%s' or outputPath '%s' is invalid", inputType.c_str(), imageDir.c_str(), outputPath.c_str());
+					goodInput = false;
+				}
+				/* Defaults: 2 decoders feeding 1 network, 1 writer */
+				if(batchReaders <= 0) batchReaders = 2;
+				if(batchNets <= 0) batchNets = 1;
+				if(batchWriters <= 0) batchWriters = 1;
+				type=BATCH;
+			}else if(inputType=="VERIFY"){
+				if(verifyFrames <= 0) verifyFrames = 1000;
+				if(verifyTolerance <= 0) verifyTolerance = 1.0;
+				type=VERIFY;
+			}else if(inputType=="MULTI"){
+				if(streams.empty()){
+					LOG_F(ERROR, "Input Type '%s' but no streams", inputType.c_str());
+					goodInput = false;
+				}
+				for(size_t i = 0; i < streams.size();++i){
+					StreamSettings& stream = streams[i];
+					if(stream.name.empty()) stream.name = cv::format("stream%zu", i);
+					if(stream.source.empty()){
+						LOG_F(ERROR, "Stream '%s' has no source", stream.name.c_str());
+						goodInput = false;
+					}
+					if(stream.priority <= 0) stream.priority = 1;
+					if(stream.fpsCap < 0) stream.fpsCap = 0;
+				}
+				if(streamNets <= 0) streamNets = 1;
+				if(streamQueue <= 0) streamQueue = 2;
+				if(maxBatch <= 0) maxBatch = 1;
+				if(batchWaitMs <= 0) batchWaitMs = 10;
+				type=MULTI;
+			}else if(inputType=="SERVER" || inputType=="CLIENT"){
+				if(socketPath.empty()) socketPath = "/tmp/openpose.sock";
+				if(serverNets <= 0) serverNets = 1;
+				if(maxBatch <= 0) maxBatch = 1;
+				if(batchWaitMs <= 0) batchWaitMs = 10;
+				if(clientRequests <= 0) clientRequests = 1;
+				if(inputType=="CLIENT" && imageFile.empty()){
+					LOG_F(ERROR, "Input Type '%s' but imageFile '%s' is invalid", inputType.c_str(), imageFile.c_str());
+					goodInput = false;
+				}
+				type = inputType=="SERVER" ? SERVER : CLIENT;
+			}else if(inputType=="SHM"){
+				if(shmName.empty() || shmName[0] != '/'){
+					LOG_F(ERROR, "Input Type '%s' but shmName '%s' is invalid (e.g. /openpose-frames)", inputType.c_str(), shmName.c_str());
+					goodInput = false;
+				}
+				/* Only used when the ring does not exist yet, otherwise the producer's header wins */
+				if(shmWidth <= 0) shmWidth = 1920;
+				if(shmHeight <= 0) shmHeight = 1080;
+				if(shmSlots <= 0) shmSlots = 4;
+				type=SHM;
+			}else if(inputType=="PIPE"){
+				if(pipeWidth <= 0 || pipeHeight <= 0){
+					LOG_F(ERROR, "Input Type '%s' but pipeWidth x pipeHeight '%d x %d' is invalid", inputType.c_str(), pipeWidth, pipeHeight);
+					goodInput = false;
+				}
+				if(pipeFps <= 0) pipeFps = 25;
+				type=PIPE;
+			}else if(inputType=="AUTOTUNE"){
+				if(device != "CPU"){
+					LOG_F(ERROR, "Input Type '%s' but device '%s' is not CPU", inputType.c_str(), device.c_str());
+					goodInput = false;
+				}
+				type=AUTOTUNE;
 			}else{
-				LOG_F(ERROR, "Input Type '%s' not Valid (valid: CAM, VIDEO, IMAGE)",inputType.c_str());
+				LOG_F(ERROR, "Input Type '%s' not Valid (valid: CAM, VIDEO, IMAGE, REPLAY, BATCH, VERIFY, MULTI, SERVER, CLIENT, SHM, PIPE, AUTOTUNE)",inputType.c_str());
 				goodInput = false;
 			}
 
@@ -214,13 +615,77 @@ class Settings{
 	public:
 		std::string modelTxt;    // model configuration, e.g. hand/pose.prototxt 
 		std::string modelBin;    // model weights, e.g. hand/pose_iter_102000.caffemodel 
+		std::string modelCache;  // FP16 copy of modelBin, built on first run (empty = off); changes the output slightly, the difference is logged when built
+
+		bool detectHands; 		// run the HAND net on crops around the wrists of every person
+		std::string handModelTxt; 	// e.g. hand/pose_deploy.prototxt
+		std::string handModelBin; 	// e.g. hand/pose_iter_102000.caffemodel
+		int handInputSize; 		// crops are resized to handInputSize x handInputSize (default 368)
+		float handThresh; 		// heatMap peak below this means the hand point is missing (default 0.1)
 
-		std::string inputType;  	// Type: (CAM, VIDEO, IMAGE)
+		int warmup; 		// warm-up forward passes in loadNet (0 = off)
+		int warmupWidth; 	// expected input frame size for the warm-up (default W_in x H_in)
+		int warmupHeight;
+
+		bool autotune; 		// CPU: pick backend / target, fusion, Winograd and threads by benchmark, cached per host (openpose/autotune.hpp)
+		std::string autotuneCache; 	// results of earlier runs (default ./autotune.yml)
+		int autotuneRuns; 	// timed forward passes per combination (default 5)
+		int dnnBackend; 	// set by autotune: cv::dnn::Backend (-1 = from device)
+		int dnnTarget; 		// set by autotune: cv::dnn::Target
+		bool dnnFusion; 	// set by autotune: Net::enableFusion
+		bool dnnWinograd; 	// set by autotune: Net::enableWinograd (OpenCV >= 4.7)
+
+		std::string inputType;  	// Type: (CAM, VIDEO, IMAGE, REPLAY, BATCH, VERIFY, MULTI, SERVER, CLIENT, SHM, PIPE, AUTOTUNE)
 		std::string imageFile;   // path to image file (containing a single person, or hand) 
 					 
 		std::string videoFile;
 		std::string outputPath;
 
+		std::string recordFile; 	// Record every netOutputBlob to this file (empty = off)
+		std::string replayFile; 	// REPLAY: recorded file fed into post-processing
+
+		int verifyFrames; 	// VERIFY: synthetic output blobs to compare (recorded ones come from replayFile)
+		float verifyTolerance; 	// VERIFY: keypoints closer than this (pixels) are the same
+		int verifySeed; 	// VERIFY: seed of the synthetic blobs
+
+		std::vector<StreamSettings> streams; 	// MULTI: input streams sharing the networks
+		int streamNets; 	// MULTI: network instances (one thread each, default 1)
+		int streamQueue; 	// MULTI: frames buffered per stream, live sources drop the oldest (default 2)
+		int maxBatch; 		// MULTI / SERVER: same size frames of different streams per forward (default 1 = no batching)
+		int batchWaitMs; 	// MULTI / SERVER: the oldest frame waits at most this long for a batch to fill (default 10)
+
+		std::string socketPath; 	// SERVER / CLIENT: Unix domain socket (default /tmp/openpose.sock)
+		int serverNets; 	// SERVER: network instances shared by all connections (default 1)
+		int clientRequests; 	// CLIENT: times imageFile is sent (default 1)
+
+		std::string shmName; 	// SHM: POSIX shared memory frame ring (openpose/shm-ring.hpp), e.g. /openpose-frames
+		int shmWidth; 		// SHM: frame size and slot count when the ring is created here (default 1920x1080, 4)
+		int shmHeight;
+		int shmSlots;
+
+		std::string resultShmName; 	// CAM / VIDEO / SHM: publish every result to this shared memory ring (openpose/shm-results.hpp, empty = off)
+		int resultShmSlots; 	// results kept for slow readers (default 8)
+		int resultShmMaxPeople; 	// people per result, the rest is cut (default 32)
+		int resultShmReaders; 	// readers that can attach at the same time (default 8)
+		bool resultShmFrame; 	// publish the rendered frame as well
+
+		int pipeWidth; 		// PIPE: raw BGR frames of pipeWidth x pipeHeight on stdin (openpose/pipe-io.hpp)
+		int pipeHeight;
+		double pipeFps; 	// PIPE: frame rate of outputPath (default 25)
+		int pipeQueue; 		// PIPE: frames buffered between stdin / stdout and the net (default 4)
+		std::string pipeOutput; 	// CAM / VIDEO / SHM / PIPE: NONE, FRAMES (rendered raw BGR) or KEYPOINTS (binary records) to stdout
+
+		double startTime; 	// CAM / VIDEO / SHM / PIPE: seconds of the source skipped before the first inferred frame
+		double endTime; 	// stop at this second of the source (0 = until EOF)
+		int frameStride; 	// infer every frameStride-th frame, the others are only grabbed (default 1)
+		std::string keypointsPath; 	// keypoints of every inferred frame as CSV (openpose/keypoint-csv.hpp, empty = off)
+		bool interpolateKeypoints; 	// keypointsPath: fill the frames skipped by frameStride by linear interpolation
+
+		std::string imageDir; 	// BATCH: directory of images, or a manifest file (one path per line)
+		int batchReaders; 	// BATCH: decoding threads
+		int batchNets; 		// BATCH: network instances (one thread each)
+		int batchWriters; 	// BATCH: threads writing results into outputPath directory
+
 		std::string device; 	 	// CPU or GPU
 		std::string dataset;     // specify what kind of model was trained. It could be (COCO, MPI, HAND) depends on dataset.
 
@@ -230,15 +695,45 @@ class Settings{
 		float thresh;       // threshold or confidence value for the heatmap
 		float scale;        // scale for blob 
 
+		bool twoPass; 		// coarse pass to find people, fine pass on their regions only
+		int coarseH; 		// input height of the coarse pass (default H_in / 2)
+		float roiThresh; 	// person probability (1 - background) of a region in the coarse pass
+		float roiPadding; 	// regions grow by this fraction on every side
+		int roiBatch; 		// regions per forward in the fine pass
+
+		int tileSize; 		// frames larger than this are run as overlapping tileSize x tileSize tiles (0 = off)
+		int tileOverlap; 	// pixels shared by neighbouring tiles, should cover a person (default tileSize / 4)
+
+		std::string heatmapPrecision; 	// full size heatMaps / PAFs in post-processing: FP32 (default), FP16 or U8
+		bool singlePerson; 	// exactly one subject: argmax of every low resolution heatMap, no PAFs, no pairing
+
+		bool renderInPlace; 	// draw on the input frame instead of a copy (SHM frames are copied out of the ring first)
+		bool renderFast; 	// no anti-aliasing (LINE_8)
+		int previewWidth; 	// display a preview of this width, the full frame is only drawn when written (0 = off)
+
 		bool goodInput;     // true if all inputs are valid
 		int type; 		// InputType
 
 		std::string logPath;  // Log Output Path (loguru)
+		int logVerbosity; 	// verbosity of the log file (default loguru::Verbosity_MAX)
+		std::string tracePath; 	// Chrome trace JSON, written at exit and on SIGUSR1 (empty = off)
+		int traceCapacity; 	// trace events kept per thread (default 65536)
+		int metricsPort; 	// Prometheus metrics on http://127.0.0.1:metricsPort (0 = off)
+		std::string metricsFile; 	// Prometheus text file, rewritten every metricsInterval seconds (empty = off)
+		int metricsInterval;
+		std::string layerProfile; 	// per-layer forward times of all frames as CSV, ranked report in the log at exit and on SIGUSR1 (empty = off)
+
+		int cpuBudget; 		// cores to use in total (0 = affinity mask / cgroup CPU quota)
+		int inferThreads; 	// cv::setNumThreads for the network (0 = what is left)
+		int postThreads; 	// post-processing cores: MULTI batching workers, SERVER connections (0 = cpuBudget / 8, clamped to what inference leaves)
+		int ioThreads; 		// capture / decode / write / pipe / metrics threads (0 = cpuBudget / 8, clamped to what inference leaves)
+		bool pinThreads; 	// pin every stage to its own cores
 
 		std::vector<std::pair<int,int>> mapIdx; 
 		std::vector<std::pair<int,int>> posePairs;
 		std::vector<std::string> keypointsMapping;
 		int nPoints;
+		int backgroundIdx; 	// background heatMap channel, -1 if the model has none
 };
 
 static inline void read(const cv::FileNode& node, Settings& s, const Settings& default_value = Settings()){
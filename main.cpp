@@ -35,11 +35,27 @@
 
 #include "./logsrc/loguru.hpp"
 #include "./openpose/multi-person-openpose.hpp"
+#include "./openpose/blob-record.hpp"
+#include "./openpose/batch-runner.hpp"
+#include "./openpose/stream-scheduler.hpp"
+#include "./openpose/pose-server.hpp"
+#include "./openpose/shm-ring.hpp"
+#include "./openpose/shm-results.hpp"
+#include "./openpose/pipe-io.hpp"
+#include "./openpose/keypoint-csv.hpp"
+#include "./openpose/thread-budget.hpp"
+#include "./openpose/autotune.hpp"
+#include "./openpose/trace.hpp"
+#include "./openpose/layer-profile.hpp"
+#include "./openpose/metrics.hpp"
+#include "./openpose/equivalence.hpp"
 #include "./include/settings.hpp"
 
 #include<iostream>
 #include<chrono>
+#include<cmath>
 #include<ctime>
+#include<unistd.h>
 #include <opencv4/opencv2/core/operations.hpp>
 #include <opencv4/opencv2/imgproc.hpp>
 #include <opencv4/opencv2/videoio.hpp>
@@ -63,11 +79,11 @@ int main(int argc, char *argv[]){
 	/* Read Settings */
 	Settings s;
 	const std::string settings_file = parser.get<std::string>(0);
-	std::cout << "Setting File: " << settings_file << std::endl;
+	std::cerr << "Setting File: " << settings_file << std::endl;
 
 	cv::FileStorage fs(settings_file, cv::FileStorage::READ);
 	if(!fs.isOpened()){
-		std::cout << "ERROR! Could not open configuration " << settings_file << std::endl;
+		std::cerr << "ERROR! Could not open configuration " << settings_file << std::endl;
 		parser.printMessage();
 		return -1;
 	}
@@ -75,13 +91,28 @@ int main(int argc, char *argv[]){
 	fs["Settings"] >> s;
 	fs.release(); 
 	if(!s.goodInput){
-		std::cout << "ERROR! Invalid input detected. Application Stopping." << std::endl;
+		std::cerr << "ERROR! Invalid input detected. Application Stopping." << std::endl;
 		parser.printMessage();
 		return -1;
 	}
 
 	LOG_F(INFO, "Program Start");
 
+	if(!s.tracePath.empty()){
+		traceEnable(s.traceCapacity, s.tracePath);
+	}
+	if(!s.layerProfile.empty()){
+		layerProfileEnable(s.layerProfile, s.dataset);
+	}
+	const ThreadBudget& budget = applyThreadBudget(s);
+	startMetrics(s);
+	if(s.type==AUTOTUNE){
+		/* One-off: measure again, update autotuneCache and exit */
+		return autotuneNet(s, budget.inference, true) ? 0 : 1;
+	}
+	if(s.autotune){
+		autotuneNet(s, budget.inference);
+	}
 	cv::dnn::Net net = initNet(s);
 
 	cv::Mat input;
@@ -96,44 +127,224 @@ int main(int argc, char *argv[]){
 			imwrite("Result.png", show);
 			cv::waitKey();
 			break;
+		case REPLAY:
+			{
+				BlobReplayer replayer;
+				if(!replayer.open(s.replayFile, s.nPoints, netOutputChannels(s))){
+					exit(-1);
+				}
+				double totalMs = 0;
+				size_t totalPeople = 0;
+				for(size_t i = 0; i < replayer.size(); ++i){
+					cv::Mat netOutputBlob = replayer.blob(i);
+					PoseResult result;
+					auto begin = std::chrono::steady_clock::now();
+					postProcess(netOutputBlob, replayer.frameSize(i), result);
+					std::chrono::duration<double, std::milli> dur = std::chrono::steady_clock::now() - begin;
+					totalMs += dur.count();
+					totalPeople += result.personwiseKeypoints.size();
+					LOG_F(1, "Frame: %-4d | people: %zu | %.3f ms", replayer.frameIndex(i), result.personwiseKeypoints.size(), dur.count());
+				}
+				if(replayer.size() > 0){
+					LOG_F(INFO, "Replayed %zu frames | people: %zu | post-process avg %.3f ms (%.2f fps)",
+							replayer.size(), totalPeople, totalMs / replayer.size(), 1000.0 * replayer.size() / totalMs);
+				}
+			}
+			break;
+		case BATCH:
+			runBatch(s);
+			break;
+		case MULTI:
+			runStreams(s);
+			break;
+		case SERVER:
+			return runServer(s);
+		case CLIENT:
+			return runClient(s) == 0 ? 0 : 1;
+		case VERIFY:
+			/* Non-zero exit status when the fast paths disagree with the reference */
+			if(runEquivalence(s) > 0){
+				return 1;
+			}
+			break;
 		default:
 			cv::VideoCapture cap;
-			if(s.type==CAM){
-				cap = cv::VideoCapture(0);
+			/* SHM frames are used in place, the slot goes back to the producer on the next read */
+			ShmFrameRing ring;
+			int64_t shmFrameIndex = 0;
+			PipeReader pipeIn;
+			int frame_width, frame_height, TotalFrame;
+			double fps;
+			if(s.type==SHM){
+				if(!ring.open(s.shmName, s.shmWidth, s.shmHeight, s.shmSlots)){
+					exit(-1);
+				}
+				frame_width = ring.width();
+				frame_height = ring.height();
+				fps = ring.fps() > 0 ? ring.fps() : 25;
+				TotalFrame = -1;
+			}else if(s.type==PIPE){
+				pipeIn.open(STDIN_FILENO, cv::Size(s.pipeWidth, s.pipeHeight), s.pipeQueue);
+				frame_width = s.pipeWidth;
+				frame_height = s.pipeHeight;
+				fps = s.pipeFps;
+				TotalFrame = -1;
 			}else{
-				cap = cv::VideoCapture(s.videoFile);
+				if(s.type==CAM){
+					cap = cv::VideoCapture(0);
+				}else{
+					cap = cv::VideoCapture(s.videoFile);
+				}
+				if(!cap.isOpened()){
+					LOG_F(ERROR, "Cam Not Open");
+					exit(-1);
+				}
+				frame_width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
+				frame_height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+				fps = cap.get(cv::CAP_PROP_FPS);
+				TotalFrame = cap.get(cv::CAP_PROP_FRAME_COUNT);
 			}
-			if(!cap.isOpened()){
-				LOG_F(ERROR, "Cam Not Open");
+
+			/* Time range and stride counted in source frames */
+			double sourceFps = fps > 0 ? fps : 25;
+			int64_t startFrame = std::llround(s.startTime * sourceFps);
+			int64_t endFrame = s.endTime > 0 ? std::llround(s.endTime * sourceFps) : -1;
+			int64_t sourceFrame = 0; 	// index of the next frame of the source
+			if(startFrame > 0 && s.type==VIDEO && cap.set(cv::CAP_PROP_POS_FRAMES, startFrame)){
+				sourceFrame = cap.get(cv::CAP_PROP_POS_FRAMES);
+			}
+			cv::Mat skipped;
+			int64_t skippedIndex;
+			auto skipFrame = [&]()->bool{
+				if(s.type==SHM) return ring.next(skipped, skippedIndex);
+				if(s.type==PIPE) return pipeIn.read(skipped);
+				/* grab() without retrieve(): no conversion to BGR */
+				return cap.grab();
+			};
+			KeypointCsvWriter keypoints;
+			if(!s.keypointsPath.empty() && !keypoints.open(s.keypointsPath, s.nPoints, sourceFps, s.interpolateKeypoints)){
 				exit(-1);
 			}
-			int frame_width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
-			int frame_height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
-			double fps = cap.get(cv::CAP_PROP_FPS);
-			int TotalFrame = cap.get(cv::CAP_PROP_FRAME_COUNT);
 
-			cv::VideoWriter writer(s.outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, cv::Size(frame_width, frame_height));
+			/* Only inferred frames are written, the video keeps its duration */
+			cv::VideoWriter writer(s.outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps / s.frameStride, cv::Size(frame_width, frame_height));
+			ShmResultWriter results;
+			std::vector<PoseKeypointRecord> records;
+			if(!s.resultShmName.empty()){
+				cv::Size publishedSize = s.resultShmFrame ? cv::Size(frame_width, frame_height) : cv::Size();
+				if(!results.open(s.resultShmName, s.resultShmSlots, s.nPoints, s.resultShmMaxPeople, s.resultShmReaders, publishedSize)){
+					exit(-1);
+				}
+			}
+			bool publishFrame = results.isOpened() && s.resultShmFrame;
+			/* stdout belongs to the pipe output, there is no window in PIPE mode */
+			PipeWriter pipeOut;
+			if(s.pipeOutput != "NONE"){
+				pipeOut.open(STDOUT_FILENO, s.pipeQueue);
+			}
+			bool pipeFrames = s.pipeOutput == "FRAMES";
+			bool headless = s.type==PIPE;
+			Counter& framesIn = metricsCounter("openpose_frames_in_total", "", "Frames decoded");
+			Counter& framesOut = metricsCounter("openpose_frames_out_total", "", "Frames written");
+			Histogram& frameLatency = stageHistogram("frame");
 			bool LOOP = true;
 			int current_frame = 0;
 			auto start = std::chrono::system_clock::now();
 			while(LOOP){
-				cap >> input;
+				int64_t frameIndex;
+				{
+					TRACE_SCOPE("capture");
+					bool more = true;
+					while(more && (sourceFrame < startFrame || (sourceFrame - startFrame) % s.frameStride != 0) && (endFrame < 0 || sourceFrame < endFrame)){
+						more = skipFrame();
+						++sourceFrame;
+					}
+					frameIndex = sourceFrame++;
+					if(!more || (endFrame >= 0 && frameIndex >= endFrame)){
+						input.release();
+					}else if(s.type==SHM){
+						if(!ring.next(input, shmFrameIndex)){
+							input.release();
+						}else if(s.renderInPlace){
+							/* input points into the producer's slot, drawing there would change the shared frame */
+							input = input.clone();
+						}
+					}else if(s.type==PIPE){
+						if(!pipeIn.read(input)){
+							input.release();
+						}
+					}else{
+						cap >> input;
+					}
+				}
 				if(input.empty()){
 					LOG_F(INFO, "Reach the EOF");
 					break;
 				}
-				show = forwardNet(input, s);
+				framesIn.add();
+				StageLatency latency(frameLatency);
+				PoseResult result;
+				detectPose(input, s, result);
+				if(keypoints.isOpened()){
+					keypoints.add(frameIndex, result);
+				}
+
+				/* Preview is drawn first: with renderInPlace the full frame is drawn on input */
+				bool preview = !headless && s.previewWidth > 0 && input.cols > s.previewWidth;
+				cv::Mat display;
+				if(preview){
+					display = renderPreview(input, result, s);
+				}
+				if((!preview && !headless) || writer.isOpened() || publishFrame || pipeFrames){
+					show = s.renderInPlace ? input : input.clone();
+					renderPose(show, result, !s.renderFast);
+				}
+				if(!preview){
+					display = show;
+				}
+
 				/* fps stuff */
 				current_frame ++;
 				auto current = std::chrono::system_clock::now();
 				std::chrono::duration<double> dur = current - start;
 				double seconds = dur.count();
 				double fps = ((double) current_frame) / seconds;
-				cv::putText(show, "Press 'q' to Exit", cv::Point(50,50), cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0, cv::Scalar(255,255,255), 2);
-				cv::putText(show, cv::format("FPS: %.4f",fps), cv::Point(50,100), cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0, cv::Scalar(255,255,255), 2);
-				imshow("Results", show);
-				char key = cv::waitKey(1);
-				writer.write(show);
+				auto drawOverlay = [fps](cv::Mat& frame){
+					cv::putText(frame, "Press 'q' to Exit", cv::Point(50,50), cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0, cv::Scalar(255,255,255), 2);
+					cv::putText(frame, cv::format("FPS: %.4f",fps), cv::Point(50,100), cv::FONT_HERSHEY_COMPLEX_SMALL, 1.0, cv::Scalar(255,255,255), 2);
+				};
+				char key = 0;
+				if(!headless){
+					TRACE_SCOPE("display");
+					drawOverlay(display);
+					imshow("Results", display);
+					key = cv::waitKey(1);
+				}
+				if(results.isOpened()){
+					TRACE_SCOPE("publish");
+					flattenPose(result, s.nPoints, records);
+					/* SHM input keeps the producer's frame numbers */
+					results.publish(s.type==SHM ? shmFrameIndex : frameIndex, records, result.personwiseKeypoints.size(), publishFrame ? show : cv::Mat());
+				}
+				if(pipeOut.isOpened()){
+					TRACE_SCOPE("pipeOut");
+					if(pipeFrames){
+						/* The writer thread keeps the frame: capture may reuse input's buffer, the overlay is drawn on show below */
+						bool owned = (s.type==PIPE || !s.renderInPlace) && !preview;
+						pipeOut.writeFrame(owned ? show : show.clone());
+					}else{
+						flattenPose(result, s.nPoints, records);
+						pipeOut.writeKeypoints(s.type==SHM ? shmFrameIndex : frameIndex, s.nPoints, result.personwiseKeypoints.size(), records);
+					}
+				}
+				if(writer.isOpened()){
+					TRACE_SCOPE("write");
+					if(preview){
+						drawOverlay(show);
+					}
+					writer.write(show);
+				}
+				framesOut.add();
 				LOG_F(INFO, "Frame: %-4d/%d | fps:%.4f ",current_frame,TotalFrame,fps);
 				if(key == 'q'){
 					LOOP = false;
@@ -141,6 +352,11 @@ int main(int argc, char *argv[]){
 			}
 			writer.release();
 			cap.release();
+			ring.close();
+			pipeIn.close();
+			pipeOut.close();
+			keypoints.close();
+			results.close();
 			break;
 	}
 	return 0;
@@ -19,6 +19,14 @@ wget -c ${OPENPOSE_URL}${COCO_MODEL} -P ${COCO_FOLDER}
 #     wget ${OPENPOSE_URL}$COCO_MODEL -P $COCO_FOLDER
 # fi
 
+# Body (MPI), the 4 stages prototxt runs the same weights with fewer refinement stages (faster)
+MPI_FOLDER=${POSE_FOLDER}"mpi/"
+MPI_MODEL=${MPI_FOLDER}"pose_iter_160000.caffemodel"
+MPI_PROTOTXT_URL="https://raw.githubusercontent.com/CMU-Perceptual-Computing-Lab/openpose/master/models/pose/mpi/"
+wget -c ${OPENPOSE_URL}${MPI_MODEL} -P ${MPI_FOLDER}
+wget -c ${MPI_PROTOTXT_URL}"pose_deploy_linevec.prototxt" -P ${MPI_FOLDER}
+wget -c ${MPI_PROTOTXT_URL}"pose_deploy_linevec_faster_4_stages.prototxt" -P ${MPI_FOLDER}
+
 # "------------------------- HAND MODELS -------------------------"
 # Hand
 HAND_MODEL=$HAND_FOLDER"pose_iter_102000.caffemodel"
@@ -0,0 +1,192 @@
+#include "autotune.hpp"
+#include "multi-person-openpose.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<opencv2/dnn.hpp>
+
+#include<algorithm>
+#include<chrono>
+#include<vector>
+
+#include<sys/stat.h>
+#include<unistd.h>
+
+static const char* backendName(int backend){
+	switch(backend){
+		case cv::dnn::DNN_BACKEND_OPENCV: return "OPENCV";
+		case cv::dnn::DNN_BACKEND_INFERENCE_ENGINE: return "INFERENCE_ENGINE";
+		default: return "OTHER";
+	}
+}
+
+static bool cpuTarget(int target){
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+	if(target == cv::dnn::DNN_TARGET_CPU_FP16) return true;
+#endif
+	return target == cv::dnn::DNN_TARGET_CPU;
+}
+
+/* Median of runs forwards, the first forward (layer setup) is not counted */
+static double timeForward(cv::dnn::Net& net, const cv::Mat& inputBlob, int runs){
+	net.setInput(inputBlob);
+	net.forward();
+	std::vector<double> ms;
+	for(int i = 0; i < runs;++i){
+		auto begin = std::chrono::steady_clock::now();
+		net.setInput(inputBlob);
+		net.forward();
+		std::chrono::duration<double, std::milli> dur = std::chrono::steady_clock::now() - begin;
+		ms.push_back(dur.count());
+	}
+	std::nth_element(ms.begin(), ms.begin() + ms.size() / 2, ms.end());
+	return ms[ms.size() / 2];
+}
+
+static std::vector<int> threadCounts(int maxThreads){
+	std::vector<int> counts;
+	for(int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+	counts.push_back(maxThreads);
+	return counts;
+}
+
+bool autotuneBenchmark(const Settings& s, int maxThreads, AutotuneResult& best){
+	cv::Size inputSize = netInputSize(cv::Size(s.warmupWidth, s.warmupHeight), s);
+	int shape[] = {1, 3, inputSize.height, inputSize.width};
+	cv::Mat inputBlob(4, shape, CV_32F);
+	cv::randu(inputBlob, 0.f, 1.f);
+	int runs = std::max(1, s.autotuneRuns);
+
+	std::vector<int> threads = threadCounts(std::max(1, maxThreads));
+	std::vector<bool> winograd = {true};
+#if OPENPOSE_HAS_WINOGRAD
+	winograd.push_back(false);
+#endif
+
+	LOG_F(INFO, "Autotune: %dx%d input, %d runs per combination, up to %d threads", inputSize.width, inputSize.height, runs, maxThreads);
+	best.ms = 0;
+	for(const std::pair<cv::dnn::Backend, cv::dnn::Target>& bt : cv::dnn::getAvailableBackends()){
+		if(!cpuTarget(bt.second)) continue;
+		/* One network per backend / target, the switches below only rebuild its layers */
+		Settings tuned = s;
+		tuned.warmup = 0;
+		tuned.dnnBackend = bt.first;
+		tuned.dnnTarget = bt.second;
+		try{
+			cv::dnn::Net net = loadNet(tuned);
+			for(bool fusion : {true, false}){
+				for(bool w : winograd){
+					net.enableFusion(fusion);
+#if OPENPOSE_HAS_WINOGRAD
+					net.enableWinograd(w);
+#endif
+					for(int t : threads){
+						cv::setNumThreads(t);
+						double ms = timeForward(net, inputBlob, runs);
+						LOG_F(INFO, "Autotune: %-16s target %d | fusion %d | winograd %d | threads %-3d | %.2f ms",
+								backendName(bt.first), bt.second, fusion, w, t, ms);
+						if(best.ms <= 0 || ms < best.ms){
+							best.backend = bt.first;
+							best.target = bt.second;
+							best.fusion = fusion;
+							best.winograd = w;
+							best.threads = t;
+							best.ms = ms;
+						}
+					}
+				}
+			}
+		}catch(const cv::Exception& e){
+			LOG_F(WARNING, "Autotune: %s target %d Failed: %s", backendName(bt.first), bt.second, e.what());
+		}
+	}
+	cv::setNumThreads(maxThreads);
+	return best.ms > 0;
+}
+
+/* Results only carry over to the same host, OpenCV build, input size, model and thread budget */
+static std::string cacheKey(const Settings& s, int maxThreads){
+	char host[256] = {};
+	gethostname(host, sizeof(host) - 1);
+	struct stat st = {};
+	stat(s.modelBin.c_str(), &st);
+	cv::Size inputSize = netInputSize(cv::Size(s.warmupWidth, s.warmupHeight), s);
+	return cv::format("%s|opencv %s|%dx%d|%s %lld|%d threads", host, CV_VERSION, inputSize.width, inputSize.height,
+			s.modelBin.c_str(), (long long)st.st_size, maxThreads);
+}
+
+static void readCache(const std::string& path, std::vector<std::string>& keys, std::vector<AutotuneResult>& results){
+	cv::FileStorage fs(path, cv::FileStorage::READ);
+	if(!fs.isOpened()) return;
+	cv::FileNode entries = fs["entries"];
+	for(cv::FileNodeIterator it = entries.begin(); it != entries.end(); ++it){
+		const cv::FileNode& e = *it;
+		AutotuneResult r;
+		std::string key;
+		int fusion = 1, winograd = 1;
+		e["key"] >> key;
+		e["backend"] >> r.backend;
+		e["target"] >> r.target;
+		e["fusion"] >> fusion;
+		e["winograd"] >> winograd;
+		e["threads"] >> r.threads;
+		e["ms"] >> r.ms;
+		r.fusion = fusion;
+		r.winograd = winograd;
+		keys.push_back(key);
+		results.push_back(r);
+	}
+}
+
+static void writeCache(const std::string& path, const std::vector<std::string>& keys, const std::vector<AutotuneResult>& results){
+	cv::FileStorage fs(path, cv::FileStorage::WRITE);
+	if(!fs.isOpened()){
+		LOG_F(WARNING, "Autotune: could not write '%s'", path.c_str());
+		return;
+	}
+	fs << "entries" << "[";
+	for(size_t i = 0; i < keys.size();++i){
+		const AutotuneResult& r = results[i];
+		fs << "{" << "key" << keys[i] << "backend" << r.backend << "target" << r.target
+			<< "fusion" << (int)r.fusion << "winograd" << (int)r.winograd << "threads" << r.threads << "ms" << r.ms << "}";
+	}
+	fs << "]";
+}
+
+bool autotuneNet(Settings& s, int maxThreads, bool force){
+	if(s.device != "CPU"){
+		LOG_F(WARNING, "Autotune: only CPU backends are tuned, device is '%s'", s.device.c_str());
+		return false;
+	}
+	std::string key = cacheKey(s, maxThreads);
+	std::vector<std::string> keys;
+	std::vector<AutotuneResult> results;
+	readCache(s.autotuneCache, keys, results);
+
+	size_t found = std::find(keys.begin(), keys.end(), key) - keys.begin();
+	AutotuneResult best;
+	if(!force && found < keys.size()){
+		best = results[found];
+		LOG_F(INFO, "Autotune: cached result from '%s'", s.autotuneCache.c_str());
+	}else{
+		if(!autotuneBenchmark(s, maxThreads, best)){
+			LOG_F(ERROR, "Autotune: no CPU backend could run the model");
+			return false;
+		}
+		if(found < keys.size()){
+			results[found] = best;
+		}else{
+			keys.push_back(key);
+			results.push_back(best);
+		}
+		writeCache(s.autotuneCache, keys, results);
+	}
+
+	s.dnnBackend = best.backend;
+	s.dnnTarget = best.target;
+	s.dnnFusion = best.fusion;
+	s.dnnWinograd = best.winograd;
+	cv::setNumThreads(best.threads);
+	LOG_F(INFO, "Autotune: %s target %d | fusion %d | winograd %d | threads %d | %.2f ms",
+			backendName(best.backend), best.target, best.fusion, best.winograd, best.threads, best.ms);
+	return true;
+}
@@ -0,0 +1,45 @@
+#ifndef __AUTOTUNE__H__
+#define __AUTOTUNE__H__
+
+#include "../include/settings.hpp"
+
+#include<opencv2/core/version.hpp>
+
+/* cv::dnn::Net::enableWinograd appeared in OpenCV 4.7 */
+#define OPENPOSE_HAS_WINOGRAD (CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 7))
+
+/**
+ * @brief 一个组合的测量结果 (ms -> 前向时间的中位数)
+ */
+struct AutotuneResult{
+	AutotuneResult():backend(-1),target(-1),fusion(true),winograd(true),threads(1),ms(0){}
+
+	int backend; 	// cv::dnn::Backend
+	int target; 	// cv::dnn::Target
+	bool fusion;
+	bool winograd;
+	int threads;
+	double ms;
+};
+
+/**
+ * @brief 在 warmupWidth x warmupHeight 对应的输入大小上测量本机 OpenCV 里所有 CPU 的
+ * 	backend / target, fusion 和 Winograd 开关, 以及 1..maxThreads 的线程数
+ * @param s
+ * @param maxThreads 	-> ThreadBudget::inference
+ * @param best 		-> 返回值
+ * @return 是否至少有一个组合能跑
+ */
+bool autotuneBenchmark(const Settings& s, int maxThreads, AutotuneResult& best);
+
+/**
+ * @brief autotune 时在 initNet 之前调用: 从 autotuneCache 里取本机 / 输入大小 / 模型对应的结果,
+ * 	没有就测一次并写回; 结果写到 s.dnnBackend ... 供 loadNet 使用, 并设置 cv::setNumThreads
+ * @param s
+ * @param maxThreads 	-> ThreadBudget::inference
+ * @param force 		-> 不读缓存, 重新测量 (AUTOTUNE 模式)
+ * @return 是否得到了结果 (否则 loadNet 按 device 选择)
+ */
+bool autotuneNet(Settings& s, int maxThreads, bool force = false);
+
+#endif
@@ -0,0 +1,179 @@
+#include "batch-runner.hpp"
+#include "blocking-queue.hpp"
+#include "multi-person-openpose.hpp"
+#include "thread-budget.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<opencv2/imgcodecs.hpp>
+
+#include<algorithm>
+#include<atomic>
+#include<cctype>
+#include<chrono>
+#include<fstream>
+#include<map>
+#include<thread>
+
+#include<errno.h>
+#include<sys/stat.h>
+
+struct BatchItem{
+	size_t index;
+	cv::Mat frame;
+};
+
+static bool isImageFile(const std::string& path){
+	static const char* extensions[] = {".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".webp"};
+	size_t dot = path.find_last_of('.');
+	if(dot == std::string::npos) return false;
+	std::string ext = path.substr(dot);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
+	for(const char* e : extensions){
+		if(ext == e) return true;
+	}
+	return false;
+}
+
+static std::string baseName(const std::string& path){
+	size_t slash = path.find_last_of('/');
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool listBatchImages(const std::string& imageDir, std::vector<std::string>& images){
+	struct stat st;
+	if(stat(imageDir.c_str(), &st) != 0){
+		LOG_F(ERROR, "Batch Input '%s' Not Found", imageDir.c_str());
+		return false;
+	}
+	if(S_ISDIR(st.st_mode)){
+		std::vector<cv::String> files;
+		cv::glob(imageDir, files, false);
+		for(const cv::String& f : files){
+			if(isImageFile(f)){
+				images.push_back(f);
+			}
+		}
+	}else{
+		std::ifstream manifest(imageDir);
+		std::string line;
+		while(std::getline(manifest, line)){
+			if(!line.empty() && line[0] != '#'){
+				images.push_back(line);
+			}
+		}
+	}
+	return true;
+}
+
+size_t runBatch(const Settings& s){
+	std::vector<std::string> images;
+	if(!listBatchImages(s.imageDir, images)){
+		return 0;
+	}
+	/* Outputs are named after the input file, two inputs with the same name would overwrite each other */
+	std::map<std::string, size_t> outputNames;
+	for(size_t i = 0; i < images.size();++i){
+		auto inserted = outputNames.insert(std::make_pair(baseName(images[i]), i));
+		if(!inserted.second){
+			LOG_F(ERROR, "Batch Inputs '%s' and '%s' have the same file name, outputs would overwrite each other",
+					images[inserted.first->second].c_str(), images[i].c_str());
+			return 0;
+		}
+	}
+	if(mkdir(s.outputPath.c_str(), 0755) != 0 && errno != EEXIST){
+		LOG_F(ERROR, "Could not create output directory '%s'", s.outputPath.c_str());
+		return 0;
+	}
+
+	int nReaders = std::max(1, s.batchReaders);
+	int nNets = std::max(1, s.batchNets);
+	int nWriters = std::max(1, s.batchWriters);
+	LOG_F(INFO, "Batch: %zu images | readers: %d | nets: %d | writers: %d", images.size(), nReaders, nNets, nWriters);
+
+	/* Decoded frames wait here for a network; bounded so prefetching can not eat the memory */
+	BlockingQueue<BatchItem> decoded(2 * nNets);
+	BlockingQueue<BatchItem> rendered(2 * nWriters);
+
+	std::atomic<size_t> nextImage(0);
+	std::atomic<int> liveReaders(nReaders);
+	std::atomic<int> liveNets(nNets);
+	std::atomic<size_t> written(0);
+
+	Counter& framesIn = metricsCounter("openpose_frames_in_total", "", "Frames decoded");
+	Counter& framesOut = metricsCounter("openpose_frames_out_total", "", "Frames written");
+	Counter& framesDropped = metricsCounter("openpose_frames_dropped_total", "", "Frames dropped");
+	Gauge& decodedDepth = metricsGauge("openpose_queue_depth", "queue=\"decoded\"", "Frames waiting in a queue");
+	Gauge& renderedDepth = metricsGauge("openpose_queue_depth", "queue=\"rendered\"", "Frames waiting in a queue");
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for(int r = 0; r < nReaders; ++r){
+		threads.emplace_back([&]{
+			pinThread(STAGE_IO);
+			size_t i;
+			while((i = nextImage++) < images.size()){
+				BatchItem item{i, cv::Mat()};
+				{
+					TRACE_SCOPE("imread");
+					item.frame = cv::imread(images[i], cv::IMREAD_COLOR);
+				}
+				if(item.frame.empty()){
+					LOG_F(WARNING, "Could not read '%s', skipped", images[i].c_str());
+					framesDropped.add();
+					continue;
+				}
+				framesIn.add();
+				decoded.push(std::move(item));
+				decodedDepth.set(decoded.size());
+			}
+			if(--liveReaders == 0){
+				decoded.close();
+			}
+		});
+	}
+	for(int n = 0; n < nNets; ++n){
+		threads.emplace_back([&]{
+			pinThread(STAGE_INFERENCE);
+			cv::dnn::Net net = loadNet(s);
+			BatchItem item;
+			while(decoded.pop(item)){
+				decodedDepth.set(decoded.size());
+				PoseResult result;
+				detectPose(net, item.frame, s, result);
+				/* The frame is owned by this item, draw on it directly */
+				renderPose(item.frame, result, !s.renderFast);
+				rendered.push(std::move(item));
+				renderedDepth.set(rendered.size());
+			}
+			if(--liveNets == 0){
+				rendered.close();
+			}
+		});
+	}
+	for(int w = 0; w < nWriters; ++w){
+		threads.emplace_back([&]{
+			pinThread(STAGE_IO);
+			BatchItem item;
+			while(rendered.pop(item)){
+				renderedDepth.set(rendered.size());
+				std::string outputFile = s.outputPath + "/" + baseName(images[item.index]);
+				if(cv::imwrite(outputFile, item.frame)){
+					size_t done = ++written;
+					LOG_F(1, "Image: %-6zu/%zu | %s", done, images.size(), outputFile.c_str());
+				}else{
+					LOG_F(WARNING, "Could not write '%s'", outputFile.c_str());
+				}
+			}
+		});
+	}
+	for(std::thread& t : threads){
+		t.join();
+	}
+
+	std::chrono::duration<double> dur = std::chrono::steady_clock::now() - start;
+	LOG_F(INFO, "Batch Finished: %zu/%zu images in %.2f s (%.2f images/s)", written.load(), images.size(), dur.count(), written.load() / dur.count());
+	return written.load();
+}
@@ -0,0 +1,29 @@
+#ifndef __BATCH_RUNNER__H__
+#define __BATCH_RUNNER__H__
+
+#include "../include/settings.hpp"
+
+#include<string>
+#include<vector>
+
+/**
+ * @brief 列出 batch 模式需要处理的图片
+ * 	imageDir 是目录 	-> 目录下所有图片 (按文件名排序)
+ * 	imageDir 是文件 	-> 清单, 每行一个图片路径
+ * @param imageDir
+ * @param images 	-> 返回值
+ * @return 		是否成功
+ */
+bool listBatchImages(const std::string& imageDir, std::vector<std::string>& images);
+
+/**
+ * @brief 批量处理图片
+ * 	batchReaders 个线程预先解码图片
+ * 	batchNets 个网络 (各一个线程) 推理 + 后处理
+ * 	batchWriters 个线程把结果写入 outputPath 目录
+ * @param s
+ * @return 成功处理的图片数
+ */
+size_t runBatch(const Settings& s);
+
+#endif
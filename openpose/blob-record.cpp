@@ -0,0 +1,148 @@
+#include "blob-record.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<cstring>
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+static const char BLOB_FILE_MAGIC[8] = {'O','P','B','L','O','B','0','1'};
+static const uint32_t BLOB_FILE_VERSION = 2; 	// 2: nPoints in the file header
+static const uint32_t BLOB_RECORD_MAGIC = 0x424F4C42;
+
+/* Records are padded to 8 bytes so that every header stays aligned in the mapping */
+static inline uint64_t paddedBytes(uint64_t bytes){
+	return (bytes + 7) & ~(uint64_t)7;
+}
+
+bool BlobRecorder::open(const std::string& path, int nPoints){
+	out.open(path, std::ios::binary | std::ios::trunc);
+	if(!out.is_open()){
+		LOG_F(ERROR, "Could not open blob record file '%s'", path.c_str());
+		return false;
+	}
+	BlobFileHeader header;
+	memcpy(header.magic, BLOB_FILE_MAGIC, sizeof(header.magic));
+	header.version = BLOB_FILE_VERSION;
+	header.nPoints = nPoints;
+	out.write((const char*)&header, sizeof(header));
+	LOG_F(INFO, "Recording network output to '%s'", path.c_str());
+	return true;
+}
+
+void BlobRecorder::write(int frameIndex, const cv::Size& frameSize, const cv::Mat& netOutputBlob){
+	if(!out.is_open()) return;
+	CV_Assert(netOutputBlob.dims == 4 && netOutputBlob.type() == CV_32F && netOutputBlob.isContinuous());
+
+	BlobRecordHeader header;
+	header.magic = BLOB_RECORD_MAGIC;
+	header.frameIndex = frameIndex;
+	header.frameWidth = frameSize.width;
+	header.frameHeight = frameSize.height;
+	for(int i = 0; i < 4;++i){
+		header.dims[i] = netOutputBlob.size[i];
+	}
+	header.payloadBytes = netOutputBlob.total() * netOutputBlob.elemSize();
+
+	static const char zeros[8] = {0};
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)netOutputBlob.data, header.payloadBytes);
+	out.write(zeros, paddedBytes(header.payloadBytes) - header.payloadBytes);
+}
+
+void BlobRecorder::close(){
+	if(out.is_open()){
+		out.close();
+	}
+}
+
+bool BlobReplayer::open(const std::string& path, int nPoints, int channels){
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0){
+		LOG_F(ERROR, "Could not open blob record file '%s'", path.c_str());
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BlobFileHeader)){
+		LOG_F(ERROR, "Blob record file '%s' is too short", path.c_str());
+		::close(fd);
+		return false;
+	}
+	length = st.st_size;
+	/* MAP_PRIVATE: post-processing may touch the Mats, never the file */
+	void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(mapped == MAP_FAILED){
+		LOG_F(ERROR, "mmap '%s' failed", path.c_str());
+		length = 0;
+		return false;
+	}
+	data = (unsigned char*)mapped;
+
+	const BlobFileHeader* fileHeader = (const BlobFileHeader*)data;
+	if(memcmp(fileHeader->magic, BLOB_FILE_MAGIC, sizeof(BLOB_FILE_MAGIC)) != 0 || (fileHeader->version != 1 && fileHeader->version != BLOB_FILE_VERSION)){
+		LOG_F(ERROR, "'%s' is not a blob record file", path.c_str());
+		close();
+		return false;
+	}
+	/* postProcess indexes heatMaps and PAFs by the current topology */
+	if(fileHeader->version >= 2 && fileHeader->nPoints != (uint32_t)nPoints){
+		LOG_F(ERROR, "'%s' was recorded with %u keypoints, the settings have %d (another dataset?)", path.c_str(), fileHeader->nPoints, nPoints);
+		close();
+		return false;
+	}
+
+	/* Build the frame index */
+	size_t offset = sizeof(BlobFileHeader);
+	while(offset + sizeof(BlobRecordHeader) <= length){
+		const BlobRecordHeader* header = (const BlobRecordHeader*)(data + offset);
+		if(header->magic != BLOB_RECORD_MAGIC){
+			LOG_F(ERROR, "Corrupted record at offset %zu, stop indexing", offset);
+			break;
+		}
+		/* The payload must be exactly the N x C x H x W floats, blob() builds the Mat from dims alone */
+		uint64_t expected = sizeof(float);
+		bool consistent = true;
+		for(int i = 0; i < 4 && consistent;++i){
+			consistent = header->dims[i] > 0 && expected * (uint64_t)header->dims[i] <= length;
+			expected *= consistent ? (uint64_t)header->dims[i] : 0;
+		}
+		if(!consistent || header->payloadBytes != expected){
+			LOG_F(ERROR, "Inconsistent record at offset %zu (dims %d x %d x %d x %d, payload %llu bytes), stop indexing", offset,
+					header->dims[0], header->dims[1], header->dims[2], header->dims[3], (unsigned long long)header->payloadBytes);
+			break;
+		}
+		if(header->dims[1] < channels){
+			LOG_F(ERROR, "Record at offset %zu has %d channels, the settings need %d (another dataset?)", offset, header->dims[1], channels);
+			close();
+			return false;
+		}
+		size_t next = offset + sizeof(BlobRecordHeader) + paddedBytes(header->payloadBytes);
+		if(offset + sizeof(BlobRecordHeader) + header->payloadBytes > length){
+			LOG_F(WARNING, "Truncated record at offset %zu, stop indexing", offset);
+			break;
+		}
+		records.push_back(header);
+		offset = next;
+	}
+	LOG_F(INFO, "Replay '%s': %zu frames", path.c_str(), records.size());
+	return true;
+}
+
+void BlobReplayer::close(){
+	if(data != nullptr){
+		munmap(data, length);
+	}
+	data = nullptr;
+	length = 0;
+	records.clear();
+}
+
+cv::Mat BlobReplayer::blob(size_t i) const{
+	const BlobRecordHeader* header = records[i];
+	float* payload = (float*)((unsigned char*)header + sizeof(BlobRecordHeader));
+	return cv::Mat(4, header->dims, CV_32F, payload);
+}
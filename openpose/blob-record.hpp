@@ -0,0 +1,82 @@
+#ifndef __BLOB_RECORD__H__
+#define __BLOB_RECORD__H__
+
+#include<opencv2/core.hpp>
+
+#include<cstdint>
+#include<fstream>
+#include<string>
+#include<vector>
+
+/*
+ * File Layout (little endian, native floats):
+ * 	BlobFileHeader
+ * 	BlobRecordHeader + payload (float32, NCHW) 	-> frame 0
+ * 	BlobRecordHeader + payload 			-> frame 1
+ * 	...
+ * Records are appended as frames arrive, so a truncated file (e.g. killed
+ * process) is still readable up to the last complete record.
+ */
+struct BlobFileHeader{
+	char magic[8]; 		// "OPBLOB01"
+	uint32_t version;
+	uint32_t nPoints; 	// keypoints of the recording topology, 0 = unknown (version 1)
+};
+
+struct BlobRecordHeader{
+	uint32_t magic; 	// 0x424F4C42 'BLOB'
+	int32_t frameIndex;
+	int32_t frameWidth; 	// size of the original input frame
+	int32_t frameHeight;
+	int32_t dims[4]; 	// N x C x H x W of netOutputBlob
+	uint64_t payloadBytes;
+};
+
+/**
+ * @brief 把每帧的 netOutputBlob 顺序写入文件
+ */
+class BlobRecorder{
+	public:
+		~BlobRecorder(){ close(); }
+
+		bool open(const std::string& path, int nPoints);
+		bool isOpened() const { return out.is_open(); }
+		void write(int frameIndex, const cv::Size& frameSize, const cv::Mat& netOutputBlob);
+		void close();
+
+	private:
+		std::ofstream out;
+};
+
+/**
+ * @brief mmap 录制好的文件, 按帧取出 netOutputBlob (不拷贝)
+ */
+class BlobReplayer{
+	public:
+		BlobReplayer():data(nullptr),length(0){}
+		~BlobReplayer(){ close(); }
+		BlobReplayer(const BlobReplayer&) = delete;
+		BlobReplayer& operator=(const BlobReplayer&) = delete;
+
+		/**
+		 * @brief 打开并建立帧索引, 录制时的拓扑和当前设置不一致时拒绝
+		 * @param path
+		 * @param nPoints 	-> 当前设置的 nPoints
+		 * @param channels 	-> postProcess 需要的通道数 (netOutputChannels)
+		 */
+		bool open(const std::string& path, int nPoints, int channels);
+		void close();
+
+		size_t size() const { return records.size(); }
+		int frameIndex(size_t i) const { return records[i]->frameIndex; }
+		cv::Size frameSize(size_t i) const { return cv::Size(records[i]->frameWidth, records[i]->frameHeight); }
+		/* The returned Mat points into the mapping and is valid until close() */
+		cv::Mat blob(size_t i) const;
+
+	private:
+		unsigned char* data;
+		size_t length;
+		std::vector<const BlobRecordHeader*> records;
+};
+
+#endif
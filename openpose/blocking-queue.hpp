@@ -0,0 +1,58 @@
+#ifndef __BLOCKING_QUEUE__H__
+#define __BLOCKING_QUEUE__H__
+
+#include<condition_variable>
+#include<deque>
+#include<mutex>
+
+/**
+ * @brief 有界阻塞队列, 用于各个线程之间传递帧
+ * 	push 	-> 队列满时阻塞
+ * 	pop 	-> 队列空时阻塞, close() 之后取完剩余元素返回 false
+ */
+template<class T>
+class BlockingQueue{
+	public:
+		explicit BlockingQueue(size_t capacity):capacity(capacity),closed(false){}
+
+		bool push(T item){
+			std::unique_lock<std::mutex> lock(mutex);
+			notFull.wait(lock, [this]{ return closed || items.size() < capacity; });
+			if(closed) return false;
+			items.push_back(std::move(item));
+			notEmpty.notify_one();
+			return true;
+		}
+
+		bool pop(T& item){
+			std::unique_lock<std::mutex> lock(mutex);
+			notEmpty.wait(lock, [this]{ return closed || !items.empty(); });
+			if(items.empty()) return false;
+			item = std::move(items.front());
+			items.pop_front();
+			notFull.notify_one();
+			return true;
+		}
+
+		void close(){
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			notEmpty.notify_all();
+			notFull.notify_all();
+		}
+
+		size_t size(){
+			std::lock_guard<std::mutex> lock(mutex);
+			return items.size();
+		}
+
+	private:
+		size_t capacity;
+		bool closed;
+		std::deque<T> items;
+		std::mutex mutex;
+		std::condition_variable notEmpty;
+		std::condition_variable notFull;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "coarse-to-fine.hpp"
+#include "trace.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+
+std::vector<cv::Rect> findPersonRegions(const cv::Mat& netOutputBlob, const cv::Size& frameSize, const Settings& s){
+	int h = netOutputBlob.size[2];
+	int w = netOutputBlob.size[3];
+
+	cv::Mat person;
+	if(s.backgroundIdx >= 0){
+		cv::Mat background(h, w, CV_32F, (void*)netOutputBlob.ptr(0, s.backgroundIdx));
+		person = 1.0 - background;
+	}else{
+		person = cv::Mat::zeros(h, w, CV_32F);
+		for(int i = 0; i < s.nPoints;++i){
+			cv::max(person, cv::Mat(h, w, CV_32F, (void*)netOutputBlob.ptr(0, i)), person);
+		}
+	}
+
+	cv::Mat mask = person > s.roiThresh;
+	cv::dilate(mask, mask, cv::Mat());
+
+	std::vector<std::vector<cv::Point>> contours;
+	cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+	double scaleX = (double)frameSize.width / (double)w;
+	double scaleY = (double)frameSize.height / (double)h;
+	cv::Rect frame(cv::Point(0, 0), frameSize);
+
+	std::vector<cv::Rect> regions;
+	for(const std::vector<cv::Point>& contour : contours){
+		cv::Rect r = cv::boundingRect(contour);
+		double x = r.x * scaleX, y = r.y * scaleY;
+		double rw = r.width * scaleX, rh = r.height * scaleY;
+		/* Limbs and heads stick out of the torso blob, pad every side */
+		double padX = rw * s.roiPadding, padY = rh * s.roiPadding;
+		cv::Rect region(cvFloor(x - padX), cvFloor(y - padY), cvCeil(rw + 2*padX), cvCeil(rh + 2*padY));
+		region &= frame;
+		if(region.area() > 0){
+			regions.push_back(region);
+		}
+	}
+
+	/* Merge overlapping regions so a person is never detected twice */
+	bool merged = true;
+	while(merged){
+		merged = false;
+		for(size_t i = 0; i < regions.size() && !merged;++i){
+			for(size_t j = i + 1; j < regions.size() && !merged;++j){
+				if((regions[i] & regions[j]).area() > 0){
+					regions[i] |= regions[j];
+					regions.erase(regions.begin() + j);
+					merged = true;
+				}
+			}
+		}
+	}
+	return regions;
+}
+
+void twoPassPose(cv::dnn::Net& net, const cv::Mat& input, const Settings& s, PoseResult& result){
+	TRACE_SCOPE("twoPassPose");
+	result.candidates.reset(s.nPoints);
+
+	/* Pass 1: same aspect ratio as the normal input, coarseH high */
+	cv::Size fineSize = netInputSize(input.size(), s);
+	cv::Size coarseSize(std::max(1, fineSize.width * s.coarseH / s.H_in), s.coarseH);
+	cv::Mat coarseOutputBlob = forwardBlob(net, cv::dnn::blobFromImage(input, s.scale, coarseSize, cv::Scalar(0, 0, 0), false, false),
+			{}, "coarseForward"); 	// not a frame output, never recorded
+
+	std::vector<cv::Rect> regions = findPersonRegions(coarseOutputBlob, input.size(), s);
+	LOG_F(1, "Coarse Pass (%dx%d): %zu Regions", coarseSize.width, coarseSize.height, regions.size());
+
+	/* Pass 2: every region is letterboxed into a H_in x H_in canvas so they can share one batch */
+	int side = s.H_in;
+	for(size_t begin = 0; begin < regions.size(); begin += s.roiBatch){
+		size_t end = std::min(regions.size(), begin + (size_t)s.roiBatch);
+
+		std::vector<cv::Mat> canvases;
+		std::vector<cv::Size> canvasSizes;
+		for(size_t i = begin; i < end;++i){
+			const cv::Rect& r = regions[i];
+			double f = std::min((double)side / r.width, (double)side / r.height);
+			cv::Size scaled(std::min(side, std::max(1, cvRound(r.width * f))), std::min(side, std::max(1, cvRound(r.height * f))));
+
+			cv::Mat canvas(side, side, input.type(), cv::Scalar::all(0));
+			cv::Mat placed = canvas(cv::Rect(cv::Point(0, 0), scaled));
+			cv::resize(input(r), placed, scaled);
+			canvases.push_back(canvas);
+			/* Upsample to the canvas size in region pixels, so keypoints come out in region coordinates */
+			int canvasInRegion = cvRound(side / f);
+			canvasSizes.push_back(cv::Size(canvasInRegion, canvasInRegion));
+		}
+
+		cv::Mat netOutputBlob = forwardBlob(net, cv::dnn::blobFromImages(canvases, s.scale, cv::Size(), cv::Scalar(0, 0, 0), false, false),
+				{}, "fineForward");
+
+		for(size_t i = begin; i < end;++i){
+			PoseResult regionResult;
+			postProcess(netOutputBlob, canvasSizes[i - begin], regionResult, (int)(i - begin));
+			mergePoseResult(result, regionResult, regions[i].tl());
+		}
+	}
+	LOG_F(1, "Fine Pass: %zu People", result.personwiseKeypoints.size());
+}
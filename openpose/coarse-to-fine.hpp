@@ -0,0 +1,30 @@
+#ifndef __COARSE_TO_FINE__H__
+#define __COARSE_TO_FINE__H__
+
+#include "multi-person-openpose.hpp"
+
+#include<opencv2/dnn.hpp>
+
+#include<vector>
+
+/**
+ * @brief 从低分辨率的 netOutputBlob 中找出有人的区域 (原图坐标)
+ * 	有 background 通道 (COCO, BODY_25) 时用 1 - background, 否则用所有 heatMap 的最大值
+ * @param netOutputBlob 	-> 第一次 (低分辨率) 的输出
+ * @param frameSize 		-> 原图大小
+ * @param s 			-> roiThresh, roiPadding
+ * @return 			互不重叠的区域
+ */
+std::vector<cv::Rect> findPersonRegions(const cv::Mat& netOutputBlob, const cv::Size& frameSize, const Settings& s);
+
+/**
+ * @brief 两次推理: 先用 coarseH 的输入找出有人的区域,
+ * 	再把所有区域放缩到 H_in x H_in 组成一个 batch 推理, 结果合并回原图坐标
+ * @param net
+ * @param input
+ * @param s
+ * @param result 	-> 返回值
+ */
+void twoPassPose(cv::dnn::Net& net, const cv::Mat& input, const Settings& s, PoseResult& result);
+
+#endif
@@ -0,0 +1,110 @@
+#include "dynamic-batcher.hpp"
+#include "multi-person-openpose.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<cstring>
+#include<vector>
+
+static bool sameShape(const cv::Mat& a, const cv::Mat& b){
+	return a.size[2] == b.size[2] && a.size[3] == b.size[3];
+}
+
+DynamicBatcher::DynamicBatcher(int maxBatch, int batchWaitMs):maxBatch(std::max(1, maxBatch)),batchWait(std::chrono::milliseconds(std::max(0, batchWaitMs))),closed(false){}
+
+cv::Mat DynamicBatcher::infer(const cv::Mat& input, const Settings& s){
+	cv::Mat inputBlob;
+	{
+		TRACE_SCOPE("blobFromImage");
+		inputBlob = cv::dnn::blobFromImage(input, s.scale, netInputSize(input.size(), s), cv::Scalar(0, 0, 0), false, false);
+	}
+	std::future<cv::Mat> output;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(Request{inputBlob, input.size(), std::promise<cv::Mat>(), Clock::now()});
+		output = pending.back().output.get_future();
+		changed.notify_all();
+	}
+	TRACE_SCOPE("batchWait");
+	return output.get();
+}
+
+void DynamicBatcher::run(cv::dnn::Net& net){
+	static Histogram& batchSize = metricsHistogram("openpose_batch_size", "", "Frames per batched forward", {1, 2, 3, 4, 6, 8, 12, 16, 24, 32});
+
+	while(true){
+		std::vector<Request> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this]{ return closed || !pending.empty(); });
+			if(pending.empty()) return;
+
+			/* The oldest frame sets the deadline, wait for same shape frames until then */
+			Clock::time_point deadline = pending.front().arrival + batchWait;
+			auto ready = [this]{
+				if(closed || pending.empty()) return true;
+				int n = 0;
+				for(const Request& r : pending){
+					n += sameShape(r.inputBlob, pending.front().inputBlob);
+				}
+				return n >= maxBatch;
+			};
+			changed.wait_until(lock, deadline, ready);
+			if(pending.empty()) continue; 	// taken by another network
+
+			cv::Mat shape = pending.front().inputBlob;
+			for(std::deque<Request>::iterator it = pending.begin(); it != pending.end() && batch.size() < maxBatch;){
+				if(sameShape(it->inputBlob, shape)){
+					batch.push_back(std::move(*it));
+					it = pending.erase(it);
+				}else{
+					++it;
+				}
+			}
+		}
+
+		int n = batch.size();
+		int inShape[] = {n, 3, batch[0].inputBlob.size[2], batch[0].inputBlob.size[3]};
+		std::vector<cv::Mat> outputs;
+		try{
+			cv::Mat inputBlob(4, inShape, CV_32F);
+			std::vector<cv::Size> frameSizes(n);
+			size_t itemBytes = batch[0].inputBlob.total() * batch[0].inputBlob.elemSize();
+			for(int i = 0; i < n;++i){
+				std::memcpy(inputBlob.ptr(i), batch[i].inputBlob.ptr(), itemBytes);
+				frameSizes[i] = batch[i].frameSize;
+			}
+
+			/* Same instrumentation and recording as the single frame path */
+			cv::Mat netOutputBlob = forwardBlob(net, inputBlob, frameSizes, "batchedForward");
+
+			/* Fan out: every frame gets its own 1 x C x H x W blob */
+			int outShape[] = {1, netOutputBlob.size[1], netOutputBlob.size[2], netOutputBlob.size[3]};
+			size_t outBytes = (size_t)outShape[1] * outShape[2] * outShape[3] * sizeof(float);
+			for(int i = 0; i < n;++i){
+				cv::Mat item(4, outShape, CV_32F);
+				std::memcpy(item.ptr(), netOutputBlob.ptr(i), outBytes);
+				outputs.push_back(item);
+			}
+		}catch(const std::exception& e){
+			/* cv::Exception, but also bad_alloc or a recorder failure: the thread lives on, every waiting frame gets an empty answer */
+			LOG_F(ERROR, "Batched Forward (%d frames) Failed: %s", n, e.what());
+			for(Request& r : batch){
+				r.output.set_value(cv::Mat());
+			}
+			continue;
+		}
+		batchSize.observe(n);
+		LOG_F(1, "Batched Forward: %d frames (%dx%d)", n, inShape[3], inShape[2]);
+		for(int i = 0; i < n;++i){
+			batch[i].output.set_value(outputs[i]);
+		}
+	}
+}
+
+void DynamicBatcher::close(){
+	std::lock_guard<std::mutex> lock(mutex);
+	closed = true;
+	changed.notify_all();
+}
@@ -0,0 +1,57 @@
+#ifndef __DYNAMIC_BATCHER__H__
+#define __DYNAMIC_BATCHER__H__
+
+#include "../include/settings.hpp"
+
+#include<opencv2/dnn.hpp>
+
+#include<chrono>
+#include<condition_variable>
+#include<deque>
+#include<future>
+#include<mutex>
+
+/**
+ * @brief 把不同线程 (不同输入) 的同样大小的帧合成一个 batch 推理
+ * 	最早的一帧到达后最多等 batchWaitMs, 或者凑够 maxBatch 帧就推理,
+ * 	负载高时 batch 变大, 负载低时延迟不超过 batchWaitMs
+ * 	infer() 可以在任意线程调用; run() 在每个网络自己的线程里调用
+ */
+class DynamicBatcher{
+	public:
+		DynamicBatcher(int maxBatch, int batchWaitMs);
+
+		/**
+		 * @brief 预处理 input 并排队, 阻塞直到所在的 batch 推理完
+		 * @param input
+		 * @param s 	-> scale, H_in, W_in
+		 * @return 	这一帧的 netOutputBlob (1 x C x H x W), forward 失败时为空
+		 */
+		cv::Mat infer(const cv::Mat& input, const Settings& s);
+
+		/**
+		 * @brief 推理循环: 取 batch, forward, 把结果分回各帧; close() 后返回
+		 * @param net 	-> 由 loadNet 得到的网络 (只在这个线程用)
+		 */
+		void run(cv::dnn::Net& net);
+
+		void close();
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+		struct Request{
+			cv::Mat inputBlob; 	// 1 x 3 x H x W
+			cv::Size frameSize; 	// input.size(), written to recordFile
+			std::promise<cv::Mat> output;
+			Clock::time_point arrival;
+		};
+
+		int maxBatch;
+		Clock::duration batchWait;
+		bool closed;
+		std::deque<Request> pending;
+		std::mutex mutex;
+		std::condition_variable changed;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include "equivalence.hpp"
+#include "reference-openpose.hpp"
+#include "blob-record.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+#include<cmath>
+
+void syntheticNetOutputBlob(const Settings& s, std::mt19937& rng, cv::Mat& netOutputBlob, cv::Size& frameSize){
+	int nChannels = 0;
+	for(const std::pair<int,int>& m : s.mapIdx){
+		nChannels = std::max(nChannels, std::max(m.first, m.second) + 1);
+	}
+	nChannels = std::max(nChannels, s.backgroundIdx + 1);
+
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	int h = std::max(8, s.H_in / 8);
+	int w = std::max(8, (int)(h * (0.75f + uniform(rng))));
+	frameSize = cv::Size(w * 8, h * 8);
+
+	int shape[] = {1, nChannels, h, w};
+	netOutputBlob.create(4, shape, CV_32F);
+	std::vector<cv::Mat> channels;
+	for(int c = 0; c < nChannels;++c){
+		cv::Mat channel(h, w, CV_32F, netOutputBlob.ptr(0, c));
+		/* Low level noise everywhere, below the keypoint threshold */
+		cv::randu(channel, 0.f, 0.05f);
+		channels.push_back(channel);
+	}
+
+	int nPeople = std::uniform_int_distribution<int>(0, 5)(rng);
+	for(int n = 0; n < nPeople;++n){
+		float cx = uniform(rng) * w, cy = uniform(rng) * h;
+		float spread = 3.f + uniform(rng) * h / 3.f;
+		std::vector<cv::Point2f> parts(s.nPoints, cv::Point2f(-1, -1));
+		for(int i = 0; i < s.nPoints;++i){
+			if(uniform(rng) < 0.2f) continue; 	// missing part
+			cv::Point2f p(cx + (uniform(rng) - 0.5f) * spread, cy + (uniform(rng) - 0.5f) * spread);
+			if(p.x < 0 || p.y < 0 || p.x >= w || p.y >= h) continue;
+			parts[i] = p;
+
+			/* Gaussian peak, sigma 1.5 heatMap pixels */
+			float amplitude = 0.3f + 0.7f * uniform(rng);
+			for(int y = std::max(0, (int)p.y - 5); y < std::min(h, (int)p.y + 6);++y){
+				float* row = channels[i].ptr<float>(y);
+				for(int x = std::max(0, (int)p.x - 5); x < std::min(w, (int)p.x + 6);++x){
+					float d2 = (x - p.x)*(x - p.x) + (y - p.y)*(y - p.y);
+					row[x] = std::max(row[x], amplitude * std::exp(-d2 / (2 * 1.5f * 1.5f)));
+				}
+			}
+		}
+		/* PAF: unit vector along the limb within 1 pixel of the segment */
+		for(int k = 0; k < s.mapIdx.size();++k){
+			const cv::Point2f& a = parts[s.posePairs[k].first];
+			const cv::Point2f& b = parts[s.posePairs[k].second];
+			if(a.x < 0 || b.x < 0) continue;
+			cv::Point2f d = b - a;
+			float norm = std::sqrt(d.dot(d));
+			if(norm < 1e-3f) continue;
+			cv::Point2f v = d / norm;
+			for(int y = 0; y < h;++y){
+				for(int x = 0; x < w;++x){
+					cv::Point2f p((float)x, (float)y);
+					float t = (p - a).dot(v);
+					if(t < 0 || t > norm) continue;
+					cv::Point2f q = p - a - t * v;
+					if(q.dot(q) > 1.f) continue;
+					channels[s.mapIdx[k].first].at<float>(y, x) = v.x;
+					channels[s.mapIdx[k].second].at<float>(y, x) = v.y;
+				}
+			}
+		}
+	}
+
+	if(s.backgroundIdx >= 0){
+		cv::Mat foreground = cv::Mat::zeros(h, w, CV_32F);
+		for(int i = 0; i < s.nPoints;++i){
+			cv::max(foreground, channels[i], foreground);
+		}
+		cv::Mat background = 1.0 - foreground;
+		background.copyTo(channels[s.backgroundIdx]);
+	}
+}
+
+static inline double distance(const cv::Point& a, const cv::Point& b){
+	return std::sqrt((double)(a.x - b.x)*(a.x - b.x) + (double)(a.y - b.y)*(a.y - b.y));
+}
+
+/* Greedy matching, returns how many points of a have no partner in b */
+static size_t matchPoints(const std::vector<cv::Point>& a, const std::vector<cv::Point>& b, double tolerance, std::vector<double>* deltas){
+	std::vector<bool> used(b.size(), false);
+	size_t unmatched = 0;
+	for(const cv::Point& p : a){
+		int best = -1;
+		double bestDist = tolerance;
+		for(int j = 0; j < b.size();++j){
+			double d = distance(p, b[j]);
+			if(!used[j] && d <= bestDist){
+				best = j;
+				bestDist = d;
+			}
+		}
+		if(best < 0){
+			++unmatched;
+		}else{
+			used[best] = true;
+			if(deltas) deltas->push_back(bestDist);
+		}
+	}
+	return unmatched;
+}
+
+/* Limb k of every person as a (point A, point B) pair, flattened as 4 ints */
+static std::vector<cv::Vec4i> personLimbs(const PoseResult& r, const Settings& s, int k){
+	std::vector<cv::Vec4i> limbs;
+	for(const std::vector<int>& person : r.personwiseKeypoints){
+		int a = person[s.posePairs[k].first];
+		int b = person[s.posePairs[k].second];
+		if(a == -1 || b == -1) continue;
+		cv::Point pa = r.candidates.point(a);
+		cv::Point pb = r.candidates.point(b);
+		limbs.push_back(cv::Vec4i(pa.x, pa.y, pb.x, pb.y));
+	}
+	return limbs;
+}
+
+static size_t matchLimbs(const std::vector<cv::Vec4i>& a, const std::vector<cv::Vec4i>& b, double tolerance){
+	std::vector<bool> used(b.size(), false);
+	size_t unmatched = 0;
+	for(const cv::Vec4i& l : a){
+		bool found = false;
+		for(int j = 0; j < b.size() && !found;++j){
+			if(!used[j] && distance(cv::Point(l[0], l[1]), cv::Point(b[j][0], b[j][1])) <= tolerance
+					&& distance(cv::Point(l[2], l[3]), cv::Point(b[j][2], b[j][3])) <= tolerance){
+				used[j] = true;
+				found = true;
+			}
+		}
+		unmatched += !found;
+	}
+	return unmatched;
+}
+
+bool compareResults(const PoseResult& reference, const PoseResult& optimized, const Settings& s, double tolerance, EquivalenceReport& report){
+	size_t keypointMismatches = 0;
+	std::vector<double> deltas;
+	for(int i = 0; i < s.nPoints;++i){
+		std::vector<cv::Point> a, b;
+		for(int j = reference.candidates.begin(i); j < reference.candidates.end(i);++j) a.push_back(reference.candidates.point(j));
+		for(int j = optimized.candidates.begin(i); j < optimized.candidates.end(i);++j) b.push_back(optimized.candidates.point(j));
+		keypointMismatches += matchPoints(a, b, tolerance, &deltas);
+		keypointMismatches += matchPoints(b, a, tolerance, nullptr);
+	}
+
+	size_t pairMismatches = 0;
+	for(int k = 0; k < s.posePairs.size();++k){
+		std::vector<cv::Vec4i> a = personLimbs(reference, s, k);
+		std::vector<cv::Vec4i> b = personLimbs(optimized, s, k);
+		pairMismatches += matchLimbs(a, b, tolerance) + matchLimbs(b, a, tolerance);
+	}
+
+	bool personMismatch = reference.personwiseKeypoints.size() != optimized.personwiseKeypoints.size();
+
+	report.frames++;
+	report.keypoints += deltas.size();
+	report.keypointMismatches += keypointMismatches;
+	report.pairMismatches += pairMismatches;
+	report.personMismatches += personMismatch;
+	for(double d : deltas){
+		report.maxDelta = std::max(report.maxDelta, d);
+		report.sumDelta += d;
+	}
+
+	bool equal = keypointMismatches == 0 && pairMismatches == 0 && !personMismatch;
+	report.failedFrames += !equal;
+	return equal;
+}
+
+static bool compareBlob(cv::Mat& netOutputBlob, const cv::Size& frameSize, const Settings& s, EquivalenceReport& report){
+	PoseResult reference, optimized;
+	referencePostProcess(netOutputBlob, frameSize, s, reference);
+	postProcess(netOutputBlob, frameSize, optimized);
+	return compareResults(reference, optimized, s, s.verifyTolerance, report);
+}
+
+static void logReport(const char* name, const EquivalenceReport& r){
+	LOG_F(INFO, "Verify %s: %zu/%zu frames differ | keypoints: %zu matched, %zu unmatched, max delta %.3f px, mean %.3f px | limbs unmatched: %zu | person count mismatches: %zu",
+			name, r.failedFrames, r.frames, r.keypoints, r.keypointMismatches, r.maxDelta, r.keypoints ? r.sumDelta / r.keypoints : 0.0,
+			r.pairMismatches, r.personMismatches);
+}
+
+size_t runEquivalence(const Settings& s){
+	std::mt19937 rng(s.verifySeed);
+	EquivalenceReport synthetic;
+	for(int f = 0; f < s.verifyFrames;++f){
+		cv::Mat netOutputBlob;
+		cv::Size frameSize;
+		syntheticNetOutputBlob(s, rng, netOutputBlob, frameSize);
+		if(!compareBlob(netOutputBlob, frameSize, s, synthetic)){
+			LOG_F(1, "Synthetic frame %d differs", f);
+		}
+	}
+	logReport("synthetic", synthetic);
+	size_t failed = synthetic.failedFrames;
+
+	if(!s.replayFile.empty()){
+		BlobReplayer replayer;
+		if(replayer.open(s.replayFile, s.nPoints, netOutputChannels(s))){
+			EquivalenceReport recorded;
+			for(size_t i = 0; i < replayer.size();++i){
+				cv::Mat netOutputBlob = replayer.blob(i);
+				if(!compareBlob(netOutputBlob, replayer.frameSize(i), s, recorded)){
+					LOG_F(1, "Recorded frame %d differs", replayer.frameIndex(i));
+				}
+			}
+			logReport("recorded", recorded);
+			failed += recorded.failedFrames;
+		}
+	}
+	return failed;
+}
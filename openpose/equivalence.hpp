@@ -0,0 +1,55 @@
+#ifndef __EQUIVALENCE__H__
+#define __EQUIVALENCE__H__
+
+#include "multi-person-openpose.hpp"
+
+#include<random>
+
+/**
+ * @brief 两个结果之间的差异 (累加)
+ * 	keypointMismatches 	-> 在 tolerance 内找不到对应点的候选点数
+ * 	pairMismatches 	-> 在 tolerance 内找不到对应的肢体 (已经组装到人身上的点对)
+ * 	personMismatches 	-> 人数不同的帧数
+ */
+struct EquivalenceReport{
+	EquivalenceReport():frames(0),failedFrames(0),keypoints(0),keypointMismatches(0),pairMismatches(0),personMismatches(0),maxDelta(0),sumDelta(0){}
+
+	size_t frames;
+	size_t failedFrames;
+	size_t keypoints; 		// matched keypoints
+	size_t keypointMismatches;
+	size_t pairMismatches;
+	size_t personMismatches;
+	double maxDelta; 		// pixels
+	double sumDelta;
+};
+
+/**
+ * @brief 生成一个假的 netOutputBlob: 随机的人, heatMap 上是高斯峰, PAF 沿肢体方向
+ * 	部分 part 随机缺失, 用来覆盖空通道的情况
+ * @param s 		-> 拓扑, H_in
+ * @param rng
+ * @param netOutputBlob 	-> 返回值 (1 x C x H_in/8 x W)
+ * @param frameSize 		-> 返回值, 对应的原图大小 (stride 8)
+ */
+void syntheticNetOutputBlob(const Settings& s, std::mt19937& rng, cv::Mat& netOutputBlob, cv::Size& frameSize);
+
+/**
+ * @brief 比较参考结果和优化后的结果
+ * @param reference
+ * @param optimized
+ * @param tolerance 	-> 像素
+ * @param report 	-> 累加
+ * @return 		这一帧是否一致
+ */
+bool compareResults(const PoseResult& reference, const PoseResult& optimized, const Settings& s, double tolerance, EquivalenceReport& report);
+
+/**
+ * @brief 在 verifyFrames 个合成的输出 (以及 replayFile 中录制的输出) 上
+ * 	比较 referencePostProcess 和 postProcess
+ * @param s
+ * @return 不一致的帧数
+ */
+size_t runEquivalence(const Settings& s);
+
+#endif
@@ -0,0 +1,184 @@
+#include "hand-pose.hpp"
+#include "multi-person-openpose.hpp"
+#include "trace.hpp"
+#include "blocking-queue.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+#include<cmath>
+#include<memory>
+
+/* Same indices in COCO, BODY_25 (and MPI) */
+static const int R_SHOULDER = 2, R_ELBOW = 3, R_WRIST = 4;
+static const int L_SHOULDER = 5, L_ELBOW = 6, L_WRIST = 7;
+
+static const int nHandPoints = 21;
+/* Reference: OpenPose HAND_PAIRS_RENDER, one hand */
+static const std::vector<std::pair<int,int>> handPairs = {
+	{0, 1}, {1, 2}, {2, 3}, {3, 4},   {0, 5}, {5, 6}, {6, 7}, {7, 8},
+	{0, 9}, {9,10}, {10,11}, {11,12},   {0,13}, {13,14}, {14,15}, {15,16},
+	{0,17}, {17,18}, {18,19}, {19,20},
+};
+
+static inline double distance(const cv::Point& a, const cv::Point& b){
+	return std::sqrt((double)(a.x - b.x)*(a.x - b.x) + (double)(a.y - b.y)*(a.y - b.y));
+}
+
+cv::Rect handRegion(const cv::Point& wrist, const cv::Point& elbow, const cv::Point& shoulder){
+	double ratio = 0.33;
+	double cx = wrist.x + ratio * (wrist.x - elbow.x);
+	double cy = wrist.y + ratio * (wrist.y - elbow.y);
+	double size = distance(wrist, elbow);
+	if(shoulder.x >= 0){
+		size = std::max(size, 0.9 * distance(elbow, shoulder));
+	}
+	size *= 1.5;
+	return cv::Rect(cvRound(cx - size / 2), cvRound(cy - size / 2), cvRound(size), cvRound(size));
+}
+
+static cv::dnn::Net loadHandNet(const Settings& s){
+	cv::dnn::Net net = cv::dnn::readNetFromCaffe(s.handModelTxt, s.handModelBin);
+	if(s.device=="CPU"){
+		net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+		net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+	}else{
+		net.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
+		net.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
+	}
+	LOG_F(INFO, "Hand Net Loaded");
+	return net;
+}
+
+cv::dnn::Net& handNet(const Settings& s){
+	/* A cv::dnn::Net is not thread safe, every worker thread gets its own */
+	thread_local cv::dnn::Net net;
+	if(net.empty()){
+		net = loadHandNet(s);
+	}
+	return net;
+}
+
+/* Shared networks, a free one is popped for a frame and pushed back afterwards */
+static std::vector<std::unique_ptr<cv::dnn::Net>> handPool;
+static std::unique_ptr<BlockingQueue<cv::dnn::Net*>> handPoolFree;
+
+void handNetPool(const Settings& s, int nets){
+	nets = std::max(1, nets);
+	handPoolFree.reset(new BlockingQueue<cv::dnn::Net*>(nets));
+	for(int i = 0; i < nets;++i){
+		handPool.emplace_back(new cv::dnn::Net(loadHandNet(s)));
+		handPoolFree->push(handPool.back().get());
+	}
+	LOG_F(INFO, "Hand Net Pool: %d networks", nets);
+}
+
+/* Holds a pooled network (or the thread's own one) until the output blob has been read */
+class HandNetLease{
+	public:
+		explicit HandNetLease(const Settings& s):pooled(nullptr){
+			if(!handPoolFree || !handPoolFree->pop(pooled)){
+				pooled = nullptr;
+			}
+			net = pooled ? pooled : &handNet(s);
+		}
+		~HandNetLease(){
+			if(pooled) handPoolFree->push(pooled);
+		}
+		cv::dnn::Net& get(){ return *net; }
+	private:
+		cv::dnn::Net* pooled;
+		cv::dnn::Net* net;
+};
+
+void detectHands(const cv::Mat& input, const PoseResult& body, const Settings& s, std::vector<HandResult>& hands){
+	TRACE_SCOPE("detectHands");
+	std::vector<cv::Mat> crops;
+	cv::Rect frame(cv::Point(0, 0), input.size());
+
+	for(int n = 0; n < body.personwiseKeypoints.size();++n){
+		const std::vector<int>& person = body.personwiseKeypoints[n];
+		for(int side = 0; side < 2;++side){
+			int wristIdx = side ? R_WRIST : L_WRIST;
+			int elbowIdx = side ? R_ELBOW : L_ELBOW;
+			int shoulderIdx = side ? R_SHOULDER : L_SHOULDER;
+			if(person[wristIdx] == -1 || person[elbowIdx] == -1){
+				continue;
+			}
+			cv::Point shoulder(-1, -1);
+			if(person[shoulderIdx] != -1){
+				shoulder = body.candidates.point(person[shoulderIdx]);
+			}
+			cv::Rect box = handRegion(body.candidates.point(person[wristIdx]), body.candidates.point(person[elbowIdx]), shoulder);
+			cv::Rect visible = box & frame;
+			if(box.width < 8 || visible.area() == 0){
+				continue;
+			}
+
+			/* Hands near the border: the part outside of the frame stays black */
+			cv::Mat crop(box.size(), input.type(), cv::Scalar::all(0));
+			cv::Mat placed = crop(visible - box.tl());
+			input(visible).copyTo(placed);
+			cv::resize(crop, crop, cv::Size(s.handInputSize, s.handInputSize));
+			crops.push_back(crop);
+
+			HandResult hand;
+			hand.person = n;
+			hand.right = side;
+			hand.box = box;
+			hands.push_back(hand);
+		}
+	}
+	if(crops.empty()){
+		return;
+	}
+
+	/* The output blob may live in the network, the lease lasts until it is parsed */
+	HandNetLease lease(s);
+	cv::dnn::Net& net = lease.get();
+	net.setInput(cv::dnn::blobFromImages(crops, s.scale, cv::Size(), cv::Scalar(0, 0, 0), false, false));
+	cv::Mat netOutputBlob = net.forward();
+	int h = netOutputBlob.size[2];
+	int w = netOutputBlob.size[3];
+
+	size_t first = hands.size() - crops.size();
+	for(size_t c = 0; c < crops.size();++c){
+		HandResult& hand = hands[first + c];
+		double scaleX = (double)hand.box.width / w;
+		double scaleY = (double)hand.box.height / h;
+		for(int i = 0; i < nHandPoints;++i){
+			cv::Mat part(h, w, CV_32F, netOutputBlob.ptr((int)c, i));
+			double maxVal;
+			cv::Point maxLoc;
+			cv::minMaxLoc(part, 0, &maxVal, 0, &maxLoc);
+			hand.scores.push_back((float)maxVal);
+			if(maxVal > s.handThresh){
+				hand.points.push_back(cv::Point(hand.box.x + cvRound((maxLoc.x + 0.5) * scaleX), hand.box.y + cvRound((maxLoc.y + 0.5) * scaleY)));
+			}else{
+				hand.points.push_back(cv::Point(-1, -1));
+			}
+		}
+	}
+	LOG_F(1, "Hands Detected: %zu", crops.size());
+}
+
+void renderHands(cv::Mat& frame, const std::vector<HandResult>& hands, bool antiAlias, double scale){
+	int lineType = antiAlias ? cv::LINE_AA : cv::LINE_8;
+	int radius = std::max(1, cvRound(3*scale));
+	int thickness = std::max(1, cvRound(2*scale));
+	for(const HandResult& hand : hands){
+		cv::Scalar color = hand.right ? cv::Scalar(0, 128, 255) : cv::Scalar(255, 128, 0);
+		for(const std::pair<int,int>& pair : handPairs){
+			const cv::Point& a = hand.points[pair.first];
+			const cv::Point& b = hand.points[pair.second];
+			if(a.x < 0 || b.x < 0){
+				continue;
+			}
+			cv::line(frame, cv::Point(cvRound(a.x*scale), cvRound(a.y*scale)), cv::Point(cvRound(b.x*scale), cvRound(b.y*scale)), color, thickness, lineType);
+		}
+		for(const cv::Point& p : hand.points){
+			if(p.x >= 0){
+				cv::circle(frame, cv::Point(cvRound(p.x*scale), cvRound(p.y*scale)), radius, color, -1, lineType);
+			}
+		}
+	}
+}
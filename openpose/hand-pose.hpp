@@ -0,0 +1,67 @@
+#ifndef __HAND_POSE__H__
+#define __HAND_POSE__H__
+
+#include "../include/settings.hpp"
+
+#include<opencv2/dnn.hpp>
+
+#include<vector>
+
+struct PoseResult;
+
+/**
+ * @brief 一只手的结果
+ * 	box 	-> 在原图中截取的区域 (正方形, 可能超出原图)
+ * 	points 	-> 21 个点 (原图坐标), scores[i] <= handThresh 的点为 (-1, -1)
+ */
+struct HandResult{
+	int person;
+	bool right;
+	cv::Rect box;
+	std::vector<cv::Point> points;
+	std::vector<float> scores;
+};
+
+/**
+ * @brief 根据手腕, 手肘, 肩膀估计手的区域 (OpenPose handDetector 的做法)
+ * @param wrist
+ * @param elbow
+ * @param shoulder 	-> 没有时传 (-1, -1)
+ * @return cv::Rect 	正方形区域
+ */
+cv::Rect handRegion(const cv::Point& wrist, const cv::Point& elbow, const cv::Point& shoulder);
+
+/**
+ * @brief 当前线程的 HAND 网络 (第一次调用时用 handModelTxt / handModelBin 加载)
+ * @param s
+ * @return cv::dnn::Net&
+ */
+cv::dnn::Net& handNet(const Settings& s);
+
+/**
+ * @brief 预先加载 nets 个 HAND 网络, 之后 detectHands 从这里借用网络, 不再用 handNet
+ * 	(SERVER: 每个连接一个线程, 不能每个连接各自加载一次)
+ * @param s
+ * @param nets
+ */
+void handNetPool(const Settings& s, int nets);
+
+/**
+ * @brief 用身体的结果截出所有手, 一次 forward 跑完一帧的所有手
+ * @param input 	-> 原图
+ * @param body 		-> detectPose 的结果
+ * @param s
+ * @param hands 	-> 返回值
+ */
+void detectHands(const cv::Mat& input, const PoseResult& body, const Settings& s, std::vector<HandResult>& hands);
+
+/**
+ * @brief 画出手的骨架
+ * @param frame
+ * @param hands
+ * @param antiAlias
+ * @param scale 	-> frame 相对于 hands 坐标的缩放
+ */
+void renderHands(cv::Mat& frame, const std::vector<HandResult>& hands, bool antiAlias, double scale);
+
+#endif
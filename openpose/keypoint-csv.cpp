@@ -0,0 +1,104 @@
+#include "keypoint-csv.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+#include<cmath>
+#include<tuple>
+
+bool KeypointCsvWriter::open(const std::string& path, int nParts, double fps, bool interpolate){
+	close();
+	f = fopen(path.c_str(), "w");
+	if(f == nullptr){
+		LOG_F(ERROR, "Keypoints: could not write '%s'", path.c_str());
+		return false;
+	}
+	this->nParts = nParts;
+	this->fps = fps > 0 ? fps : 25;
+	this->interpolate = interpolate;
+	lastFrame = -1;
+	last.clear();
+	fprintf(f, "frame,time,person,part,x,y,score,interpolated\n");
+	return true;
+}
+
+void KeypointCsvWriter::writeRows(int64_t frame, const std::vector<PoseKeypointRecord>& records, const std::vector<size_t>* persons){
+	for(size_t r = 0; r < records.size();++r){
+		const PoseKeypointRecord& k = records[r];
+		size_t person = persons ? (*persons)[r / nParts] : r / nParts;
+		fprintf(f, "%lld,%.4f,%zu,%zu,%.1f,%.1f,%.4f,%d\n", (long long)frame, frame / fps, person, r % nParts, k.x, k.y, k.score, persons ? 1 : 0);
+	}
+}
+
+/* Mean of the parts that were found, (-1, -1) for nobody */
+static cv::Point2f centroid(const PoseKeypointRecord* person, int nParts){
+	cv::Point2f sum(0, 0);
+	int n = 0;
+	for(int i = 0; i < nParts;++i){
+		if(person[i].score <= 0) continue;
+		sum += cv::Point2f(person[i].x, person[i].y);
+		++n;
+	}
+	return n ? sum / n : cv::Point2f(-1, -1);
+}
+
+void KeypointCsvWriter::add(int64_t frame, const PoseResult& result){
+	std::vector<PoseKeypointRecord> current;
+	flattenPose(result, nParts, current);
+
+	if(interpolate && lastFrame >= 0 && frame - lastFrame > 1 && !last.empty() && !current.empty()){
+		size_t nA = last.size() / nParts, nB = current.size() / nParts;
+		std::vector<std::tuple<float, size_t, size_t>> distances;
+		for(size_t a = 0; a < nA;++a){
+			cv::Point2f ca = centroid(&last[a * nParts], nParts);
+			if(ca.x < 0) continue;
+			for(size_t b = 0; b < nB;++b){
+				cv::Point2f cb = centroid(&current[b * nParts], nParts);
+				if(cb.x < 0) continue;
+				cv::Point2f d = ca - cb;
+				distances.push_back(std::make_tuple(std::sqrt(d.dot(d)), a, b));
+			}
+		}
+		/* Greedy: closest centroids first */
+		std::sort(distances.begin(), distances.end());
+		std::vector<bool> usedA(nA, false), usedB(nB, false);
+		std::vector<std::pair<size_t, size_t>> matches;
+		for(const auto& d : distances){
+			size_t a = std::get<1>(d), b = std::get<2>(d);
+			if(usedA[a] || usedB[b]) continue;
+			usedA[a] = usedB[b] = true;
+			matches.push_back(std::make_pair(a, b));
+		}
+
+		/* Interpolated people keep the index they have in the later frame */
+		std::vector<size_t> persons;
+		for(const auto& m : matches) persons.push_back(m.second);
+		std::vector<PoseKeypointRecord> between(matches.size() * nParts);
+		for(int64_t g = lastFrame + 1; g < frame;++g){
+			float t = (float)(g - lastFrame) / (frame - lastFrame);
+			for(size_t m = 0; m < matches.size();++m){
+				const PoseKeypointRecord* a = &last[matches[m].first * nParts];
+				const PoseKeypointRecord* b = &current[matches[m].second * nParts];
+				for(int i = 0; i < nParts;++i){
+					PoseKeypointRecord& k = between[m * nParts + i];
+					if(a[i].score <= 0 || b[i].score <= 0){
+						k = PoseKeypointRecord{-1.f, -1.f, 0.f};
+					}else{
+						k = PoseKeypointRecord{a[i].x + t * (b[i].x - a[i].x), a[i].y + t * (b[i].y - a[i].y), a[i].score + t * (b[i].score - a[i].score)};
+					}
+				}
+			}
+			writeRows(g, between, &persons);
+		}
+	}
+
+	writeRows(frame, current, nullptr);
+	lastFrame = frame;
+	last.swap(current);
+}
+
+void KeypointCsvWriter::close(){
+	if(f != nullptr){
+		fclose(f);
+		f = nullptr;
+	}
+}
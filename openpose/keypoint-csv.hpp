@@ -0,0 +1,51 @@
+#ifndef __KEYPOINT_CSV__H__
+#define __KEYPOINT_CSV__H__
+
+#include "pose-wire.hpp"
+
+#include<cstdint>
+#include<cstdio>
+#include<string>
+#include<vector>
+
+/*
+ * One row per part of every person:
+ * 	frame,time,person,part,x,y,score,interpolated
+ * a missing part is x = y = -1, score 0
+ */
+class KeypointCsvWriter{
+	public:
+		KeypointCsvWriter():f(nullptr),nParts(0),interpolate(false),lastFrame(-1){}
+		~KeypointCsvWriter(){ close(); }
+
+		/**
+		 * @brief
+		 * @param path
+		 * @param nParts 	-> Settings::nPoints
+		 * @param fps 		-> 源的帧率, 用来算 time
+		 * @param interpolate 	-> 两个采样帧之间的帧用线性插值补上
+		 */
+		bool open(const std::string& path, int nParts, double fps, bool interpolate);
+		bool isOpened() const { return f != nullptr; }
+
+		/**
+		 * @brief 写一个推理过的帧 (frame 递增)
+		 * 	interpolate 时先补上一个采样帧到这一帧之间的帧:
+		 * 	两帧的人按重心就近配对, 两边都有的 part 才插值, 没配上的人不补
+		 */
+		void add(int64_t frame, const PoseResult& result);
+		void close();
+
+	private:
+		/* persons != nullptr -> interpolated rows, the person index of each record group */
+		void writeRows(int64_t frame, const std::vector<PoseKeypointRecord>& records, const std::vector<size_t>* persons);
+
+		FILE* f;
+		int nParts;
+		double fps;
+		bool interpolate;
+		int64_t lastFrame;
+		std::vector<PoseKeypointRecord> last;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "layer-profile.hpp"
+#include "trace.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+#include<map>
+#include<mutex>
+#include<vector>
+
+#include<unistd.h>
+
+std::atomic<bool> layerProfileOn(false);
+
+static std::mutex profileMutex;
+static std::string profilePath;
+static std::string profileDataset;
+static std::vector<std::string> layerNames;
+static std::vector<std::string> layerTypes;
+static std::vector<double> layerTotalMs;
+static std::vector<double> layerMaxMs;
+static size_t profiledForwards = 0;
+static double forwardTotalMs = 0;
+
+static std::string layerStage(const std::string& name){
+	bool l1 = name.find("_L1") != std::string::npos;
+	bool l2 = name.find("_L2") != std::string::npos;
+	if(l1 || l2){
+		bool paf = profileDataset == "BODY_25" ? l2 : l1;
+		return paf ? "PAF stages" : "heatmap stages";
+	}
+	if(name.compare(0, 1, "M") == 0){
+		return "refinement stages";
+	}
+	if(name.find("conv") != std::string::npos || name.find("relu") != std::string::npos || name.find("pool") != std::string::npos){
+		return "VGG backbone";
+	}
+	return "other";
+}
+
+static void layerProfileDump(){
+	layerProfileReport();
+}
+
+void layerProfileEnable(const std::string& path, const std::string& dataset){
+	profilePath = path;
+	profileDataset = dataset;
+	layerProfileOn.store(true);
+	std::atexit(layerProfileDump);
+	/* SERVER and live sources rarely exit normally, 'kill -USR1' writes the report on demand */
+	traceOnSignal(layerProfileDump);
+	LOG_F(INFO, "Layer Profile Enabled: report at exit and on 'kill -USR1 %d', CSV '%s'", (int)getpid(), path.c_str());
+}
+
+void layerProfileCollect(cv::dnn::Net& net){
+	std::vector<double> timings;
+	double ticksPerMs = cv::getTickFrequency() / 1000.0;
+	double totalMs = net.getPerfProfile(timings) / ticksPerMs;
+
+	std::lock_guard<std::mutex> lock(profileMutex);
+	if(layerNames.empty()){
+		/* getPerfProfile and getLayerNames both skip the input layer, same order */
+		for(const std::string& name : net.getLayerNames()){
+			layerNames.push_back(name);
+			layerTypes.push_back(net.getLayer(net.getLayerId(name))->type);
+		}
+		layerTotalMs.assign(layerNames.size(), 0);
+		layerMaxMs.assign(layerNames.size(), 0);
+	}
+	if(timings.size() != layerNames.size()){
+		LOG_F(WARNING, "Layer Profile: %zu timings for %zu layers, forward skipped", timings.size(), layerNames.size());
+		return;
+	}
+	for(size_t i = 0; i < timings.size();++i){
+		double ms = timings[i] / ticksPerMs;
+		layerTotalMs[i] += ms;
+		layerMaxMs[i] = std::max(layerMaxMs[i], ms);
+	}
+	forwardTotalMs += totalMs;
+	++profiledForwards;
+}
+
+bool layerProfileReport(){
+	std::lock_guard<std::mutex> lock(profileMutex);
+	if(profiledForwards == 0){
+		LOG_F(WARNING, "Layer Profile: no forward passes profiled");
+		return false;
+	}
+	double n = (double)profiledForwards;
+	std::vector<size_t> order(layerNames.size());
+	for(size_t i = 0; i < order.size();++i) order[i] = i;
+	std::sort(order.begin(), order.end(), [](size_t a, size_t b){ return layerTotalMs[a] > layerTotalMs[b]; });
+
+	std::map<std::string, double> stageMs;
+	std::map<std::string, int> stageLayers;
+	for(size_t i = 0; i < layerNames.size();++i){
+		std::string stage = layerStage(layerNames[i]);
+		stageMs[stage] += layerTotalMs[i];
+		stageLayers[stage]++;
+	}
+	std::vector<std::pair<double, std::string>> stages;
+	for(const auto& st : stageMs) stages.push_back(std::make_pair(st.second, st.first));
+	std::sort(stages.rbegin(), stages.rend());
+
+	LOG_F(INFO, "Layer Profile: %zu forward passes, %.3f ms per forward", profiledForwards, forwardTotalMs / n);
+	for(const auto& st : stages){
+		LOG_F(INFO, "Stage %-18s | %3d layers | %9.3f ms | %5.1f%%", st.second.c_str(), stageLayers[st.second], st.first / n, 100.0 * st.first / forwardTotalMs);
+	}
+	for(size_t r = 0; r < std::min<size_t>(20, order.size());++r){
+		size_t i = order[r];
+		LOG_F(INFO, "#%-3zu %-28s %-14s %-18s | %9.3f ms | %5.1f%%", r + 1, layerNames[i].c_str(), layerTypes[i].c_str(),
+				layerStage(layerNames[i]).c_str(), layerTotalMs[i] / n, 100.0 * layerTotalMs[i] / forwardTotalMs);
+	}
+
+	FILE* f = fopen(profilePath.c_str(), "w");
+	if(f == nullptr){
+		LOG_F(ERROR, "Layer Profile: could not write '%s'", profilePath.c_str());
+		return false;
+	}
+	fprintf(f, "rank,layer,type,stage,mean_ms,max_ms,share\n");
+	for(size_t r = 0; r < order.size();++r){
+		size_t i = order[r];
+		fprintf(f, "%zu,%s,%s,%s,%.4f,%.4f,%.5f\n", r + 1, layerNames[i].c_str(), layerTypes[i].c_str(), layerStage(layerNames[i]).c_str(),
+				layerTotalMs[i] / n, layerMaxMs[i], layerTotalMs[i] / forwardTotalMs);
+	}
+	fclose(f);
+	LOG_F(INFO, "Layer Profile: %zu layers written to '%s'", layerNames.size(), profilePath.c_str());
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef __LAYER_PROFILE__H__
+#define __LAYER_PROFILE__H__
+
+#include<opencv2/dnn.hpp>
+
+#include<atomic>
+#include<string>
+
+/*
+ * 每层的前向时间 (cv::dnn::Net::getPerfProfile), 累加所有帧.
+ * 按层名分到各阶段:
+ * 	*_L1 / *_L2 	-> PAF stages / heatmap stages (BODY_25: L2 = PAF, COCO / MPI: L1 = PAF)
+ * 	Mconv* 		-> refinement stages (HAND, 没有 L1 / L2)
+ * 	conv / relu / pool 	-> VGG backbone
+ * 退出时 (以及收到 SIGUSR1 时) 把排序后的报告写进 log, 所有层写成 CSV.
+ * 融合进前一层的层 (BatchNorm, ReLU ...) 时间为 0.
+ */
+
+extern std::atomic<bool> layerProfileOn;
+
+/**
+ * @brief 打开 per-layer profile, 退出时和收到 SIGUSR1 时写报告
+ * 	需要在创建其他线程之前调用 (SIGUSR1, 见 traceOnSignal)
+ * @param path 		-> CSV 输出路径
+ * @param dataset 	-> Settings::dataset, 决定 L1 / L2 的含义
+ */
+void layerProfileEnable(const std::string& path, const std::string& dataset);
+
+/**
+ * @brief forward 之后调用, 累加这一次的各层时间 (线程安全)
+ * @param net
+ */
+void layerProfileCollect(cv::dnn::Net& net);
+
+/**
+ * @brief 写报告 (log) 和 CSV
+ * @return 是否成功
+ */
+bool layerProfileReport();
+
+#endif
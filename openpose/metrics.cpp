@@ -0,0 +1,211 @@
+#include "metrics.hpp"
+#include "thread-budget.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<cstdio>
+#include<cstdlib>
+#include<map>
+#include<memory>
+#include<mutex>
+#include<sstream>
+#include<thread>
+
+#include<arpa/inet.h>
+#include<netinet/in.h>
+#include<sys/socket.h>
+#include<sys/time.h>
+#include<unistd.h>
+
+Histogram::Histogram(const std::vector<double>& bounds):bounds(bounds),buckets(bounds.size() + 1),count(0),sum(0){
+	for(std::atomic<uint64_t>& b : buckets) b.store(0);
+}
+
+void Histogram::observe(double v){
+	size_t i = 0;
+	while(i < bounds.size() && v > bounds[i]) ++i;
+	buckets[i].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	double old = sum.load(std::memory_order_relaxed);
+	while(!sum.compare_exchange_weak(old, old + v, std::memory_order_relaxed));
+}
+
+const std::vector<double>& latencyBuckets(){
+	static const std::vector<double> bounds = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+	return bounds;
+}
+
+/* One family per metric name, one series per label set */
+struct MetricFamily{
+	std::string type;
+	std::string help;
+	std::map<std::string, std::unique_ptr<Counter>> counters;
+	std::map<std::string, std::unique_ptr<Gauge>> gauges;
+	std::map<std::string, std::unique_ptr<Histogram>> histograms;
+};
+
+static std::mutex registryMutex;
+static std::map<std::string, MetricFamily> registry;
+
+static MetricFamily& family(const std::string& name, const std::string& type, const std::string& help){
+	MetricFamily& f = registry[name];
+	if(f.type.empty()){
+		f.type = type;
+		f.help = help;
+	}
+	return f;
+}
+
+Counter& metricsCounter(const std::string& name, const std::string& labels, const std::string& help){
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::unique_ptr<Counter>& c = family(name, "counter", help).counters[labels];
+	if(!c) c.reset(new Counter());
+	return *c;
+}
+
+Gauge& metricsGauge(const std::string& name, const std::string& labels, const std::string& help){
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::unique_ptr<Gauge>& g = family(name, "gauge", help).gauges[labels];
+	if(!g) g.reset(new Gauge());
+	return *g;
+}
+
+Histogram& metricsHistogram(const std::string& name, const std::string& labels, const std::string& help, const std::vector<double>& bounds){
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::unique_ptr<Histogram>& h = family(name, "histogram", help).histograms[labels];
+	if(!h) h.reset(new Histogram(bounds));
+	return *h;
+}
+
+std::string metricsLabel(const std::string& key, const std::string& value){
+	std::string label = key + "=\"";
+	for(char c : value){
+		if(c == '\\') label += "\\\\";
+		else if(c == '"') label += "\\\"";
+		else if(c == '\n') label += "\\n";
+		else label += c;
+	}
+	return label + "\"";
+}
+
+Histogram& stageHistogram(const std::string& stage){
+	return metricsHistogram("openpose_stage_seconds", metricsLabel("stage", stage), "Latency of a pipeline stage", latencyBuckets());
+}
+
+static std::string series(const std::string& name, const std::string& labels, const std::string& extra = ""){
+	std::string all = labels;
+	if(!extra.empty()) all += (all.empty() ? "" : ",") + extra;
+	return all.empty() ? name : name + "{" + all + "}";
+}
+
+std::string metricsText(){
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::ostringstream os;
+	for(const auto& entry : registry){
+		const std::string& name = entry.first;
+		const MetricFamily& f = entry.second;
+		os << "# HELP " << name << " " << f.help << "\n";
+		os << "# TYPE " << name << " " << f.type << "\n";
+		for(const auto& c : f.counters){
+			os << series(name, c.first) << " " << c.second->get() << "\n";
+		}
+		for(const auto& g : f.gauges){
+			os << series(name, g.first) << " " << g.second->get() << "\n";
+		}
+		for(const auto& h : f.histograms){
+			const Histogram& hist = *h.second;
+			uint64_t cumulative = 0;
+			for(size_t i = 0; i < hist.bounds.size(); ++i){
+				cumulative += hist.buckets[i].load(std::memory_order_relaxed);
+				os << series(name + "_bucket", h.first, cv::format("le=\"%g\"", hist.bounds[i])) << " " << cumulative << "\n";
+			}
+			cumulative += hist.buckets.back().load(std::memory_order_relaxed);
+			os << series(name + "_bucket", h.first, "le=\"+Inf\"") << " " << cumulative << "\n";
+			os << series(name + "_sum", h.first) << " " << hist.sum.load(std::memory_order_relaxed) << "\n";
+			os << series(name + "_count", h.first) << " " << hist.count.load(std::memory_order_relaxed) << "\n";
+		}
+	}
+	return os.str();
+}
+
+static void serveMetrics(int port){
+	pinThread(STAGE_IO);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0){
+		LOG_F(ERROR, "Metrics: could not listen on 127.0.0.1:%d", port);
+		if(fd >= 0) close(fd);
+		return;
+	}
+	LOG_F(INFO, "Metrics: http://127.0.0.1:%d/metrics", port);
+	while(true){
+		int client = accept(fd, nullptr, nullptr);
+		if(client < 0) continue;
+		/* An idle client must not stall the exporter */
+		timeval timeout = {1, 0};
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		/* Any request gets the metrics, the request itself is not parsed */
+		char request[1024];
+		if(recv(client, request, sizeof(request), 0) > 0){
+			std::string body = metricsText();
+			std::string response = cv::format("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", body.size()) + body;
+			size_t sent = 0;
+			while(sent < response.size()){
+				ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+				if(n <= 0) break;
+				sent += n;
+			}
+		}
+		close(client);
+	}
+}
+
+static std::mutex fileMutex;
+static std::string metricsPath;
+
+static void writeMetricsSnapshot(){
+	std::lock_guard<std::mutex> lock(fileMutex);
+	std::string tmp = metricsPath + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w");
+	if(f == nullptr){
+		LOG_F(WARNING, "Metrics: could not write '%s'", tmp.c_str());
+		return;
+	}
+	std::string body = metricsText();
+	fwrite(body.data(), 1, body.size(), f);
+	fclose(f);
+	/* rename is atomic, readers never see a half written file */
+	std::rename(tmp.c_str(), metricsPath.c_str());
+}
+
+static void writeMetricsFile(int interval){
+	pinThread(STAGE_IO);
+	while(true){
+		std::this_thread::sleep_for(std::chrono::seconds(interval));
+		writeMetricsSnapshot();
+	}
+}
+
+void stopMetrics(){
+	if(!metricsPath.empty()){
+		writeMetricsSnapshot();
+	}
+}
+
+void startMetrics(const Settings& s){
+	if(s.metricsPort > 0){
+		std::thread(serveMetrics, s.metricsPort).detach();
+	}
+	if(!s.metricsFile.empty()){
+		LOG_F(INFO, "Metrics: '%s' every %d s", s.metricsFile.c_str(), s.metricsInterval);
+		metricsPath = s.metricsFile;
+		std::thread(writeMetricsFile, s.metricsInterval).detach();
+		/* Counters of the last interval would be lost otherwise */
+		std::atexit(stopMetrics);
+	}
+}
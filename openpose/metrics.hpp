@@ -0,0 +1,107 @@
+#ifndef __METRICS__H__
+#define __METRICS__H__
+
+#include "../include/settings.hpp"
+
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<string>
+#include<vector>
+
+/*
+ * 运行时指标 (counter / gauge / histogram), 以 Prometheus text 格式导出:
+ * 	metricsPort 	-> 本地 HTTP (127.0.0.1:port/metrics)
+ * 	metricsFile 	-> 每 metricsInterval 秒写一次文件
+ * 注册需要加锁 (只在第一次), 更新都是原子操作.
+ */
+
+class Counter{
+	public:
+		Counter():value(0){}
+		void add(uint64_t n = 1){ value.fetch_add(n, std::memory_order_relaxed); }
+		uint64_t get() const { return value.load(std::memory_order_relaxed); }
+	private:
+		std::atomic<uint64_t> value;
+};
+
+class Gauge{
+	public:
+		Gauge():value(0){}
+		void set(double v){ value.store(v, std::memory_order_relaxed); }
+		double get() const { return value.load(std::memory_order_relaxed); }
+		/* Atomic read-modify-write, for gauges changed from several threads */
+		void add(double d){
+			double old = value.load(std::memory_order_relaxed);
+			while(!value.compare_exchange_weak(old, old + d, std::memory_order_relaxed));
+		}
+	private:
+		std::atomic<double> value;
+};
+
+class Histogram{
+	public:
+		explicit Histogram(const std::vector<double>& bounds);
+		void observe(double v);
+
+		std::vector<double> bounds; 	// upper bounds, +Inf is implicit
+		std::vector<std::atomic<uint64_t>> buckets; 	// not cumulative
+		std::atomic<uint64_t> count;
+		std::atomic<double> sum;
+};
+
+/* Buckets for stage latencies in seconds: 0.5 ms .. 10 s */
+const std::vector<double>& latencyBuckets();
+
+/**
+ * @brief 取得 (第一次时注册) 一个指标, 返回的引用一直有效
+ * @param name 		-> 指标名, e.g. openpose_frames_in_total
+ * @param labels 	-> Prometheus labels, e.g. stage="forward" (可以为空)
+ * @param help 		-> HELP 文本
+ */
+Counter& metricsCounter(const std::string& name, const std::string& labels, const std::string& help);
+Gauge& metricsGauge(const std::string& name, const std::string& labels, const std::string& help);
+Histogram& metricsHistogram(const std::string& name, const std::string& labels, const std::string& help, const std::vector<double>& bounds);
+
+/**
+ * @brief 一个 label: key="value", value 中的 \\, " 和换行会被转义
+ */
+std::string metricsLabel(const std::string& key, const std::string& value);
+
+/**
+ * @brief 所有指标的 Prometheus text exposition
+ */
+std::string metricsText();
+
+/**
+ * @brief 按设置启动 HTTP 导出 和/或 文件导出 (后台线程)
+ * @param s
+ */
+void startMetrics(const Settings& s);
+
+/**
+ * @brief 写最后一次 metricsFile 快照 (startMetrics 已注册到 atexit)
+ */
+void stopMetrics();
+
+/**
+ * @brief 作用域结束时把耗时 (秒) 记入 histogram
+ */
+class StageLatency{
+	public:
+		explicit StageLatency(Histogram& histogram):histogram(histogram),begin(std::chrono::steady_clock::now()){}
+		~StageLatency(){
+			std::chrono::duration<double> dur = std::chrono::steady_clock::now() - begin;
+			histogram.observe(dur.count());
+		}
+	private:
+		Histogram& histogram;
+		std::chrono::steady_clock::time_point begin;
+};
+
+/**
+ * @brief 各阶段耗时的 histogram: openpose_stage_seconds{stage="..."}
+ */
+Histogram& stageHistogram(const std::string& stage);
+
+#endif
@@ -1,5 +1,17 @@
 #include "multi-person-openpose.hpp"
+#include "blob-record.hpp"
+#include "coarse-to-fine.hpp"
+#include "tiled-pose.hpp"
+#include "autotune.hpp"
+#include "layer-profile.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
 #include <opencv4/opencv2/highgui.hpp>
+#include <mutex>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <unistd.h>
 ////////////////////////////////
 std::ostream& operator << (std::ostream& os, const KeyPoint& kp)
 {
@@ -47,18 +59,66 @@ std::vector<std::pair<int,int>> posePairs;
 
 std::vector<cv::Scalar> colors;
 
+/* A heatMap pixel above this is a keypoint candidate */
+const double heatMapThresh = 0.1;
+
+/* Depth of the full size heatMaps / PAFs (heatmapPrecision): CV_32F, CV_16F or CV_8U */
+int heatMapDepth = CV_32F;
+
+/* Exactly one subject: argmax per heatMap, PAFs are never read */
+bool singlePerson = false;
+
+/**
+ * @brief CV_8U 平面的量化方式: heatMap 存 v*255, PAF (范围 [-1,1]) 存 v*127.5+127.5
+ * @param paf 	-> 是否是 PAF 通道
+ * @param alpha 	-> 返回值
+ * @param beta 	-> 返回值
+ */
+static inline void quantization(bool paf, double& alpha, double& beta){
+	alpha = paf ? 127.5 : 255.0;
+	beta = paf ? 127.5 : 0.0;
+}
+
+/**
+ * @brief 读 heatMap / PAF 平面上的一个值 (CV_32F, CV_16F 或 CV_8U)
+ */
+static inline float planeAt(const cv::Mat& plane, int y, int x, bool paf){
+	switch(plane.depth()){
+		case CV_8U:{
+			double alpha, beta;
+			quantization(paf, alpha, beta);
+			return (float)((plane.at<uchar>(y,x) - beta) / alpha);
+		}
+		case CV_16F:
+			return (float)plane.at<cv::float16_t>(y,x);
+		default:
+			return plane.at<float>(y,x);
+	}
+}
+
 /**
  * @brief 对于每个 body part 的 heatMap 找到其中可能的 ketPoints
- * @param probMap 	-> 某个 body part 的 heatMap
+ * @param probMap 	-> 某个 body part 的 heatMap (CV_32F, CV_16F 或 CV_8U)
  * @param threshold 	-> 大于它就认为是
- * @param keyPoints 	-> Return 值
+ * @param candidates 	-> 追加到最后一个 part
  */
-void getKeyPoints(cv::Mat& probMap,double threshold,std::vector<KeyPoint>& keyPoints){
+void getKeyPoints(cv::Mat& probMap,double threshold,CandidateTable& candidates){
+	TRACE_SCOPE("getKeyPoints");
+	cv::Mat plane = probMap;
+	double alpha = 1.0, beta = 0.0;
+	if(probMap.depth() == CV_16F){
+		/* GaussianBlur has no FP16 path, only this plane is widened */
+		probMap.convertTo(plane, CV_32F);
+	}else if(probMap.depth() == CV_8U){
+		/* Blur and threshold directly on the 8 bit plane */
+		quantization(false, alpha, beta);
+	}
+
 	cv::Mat smoothProbMap;
-	cv::GaussianBlur( probMap, smoothProbMap, cv::Size( 3, 3 ), 0, 0 );
+	cv::GaussianBlur( plane, smoothProbMap, cv::Size( 3, 3 ), 0, 0 );
 
 	cv::Mat maskedProbMap;
-	cv::threshold(smoothProbMap,maskedProbMap,threshold,255,cv::THRESH_BINARY);
+	cv::threshold(smoothProbMap,maskedProbMap,threshold*alpha + beta,255,cv::THRESH_BINARY);
 
 	maskedProbMap.convertTo(maskedProbMap,CV_8U,1);
 
@@ -75,7 +135,7 @@ void getKeyPoints(cv::Mat& probMap,double threshold,std::vector<KeyPoint>& keyPo
 
 		cv::minMaxLoc(smoothProbMap.mul(blobMask),0,&maxVal,0,&maxLoc);
 
-		keyPoints.push_back(KeyPoint(maxLoc, probMap.at<float>(maxLoc.y,maxLoc.x)));
+		candidates.push(maxLoc, planeAt(probMap, maxLoc.y, maxLoc.x, false));
 	}
 }
 
@@ -100,25 +160,48 @@ void populateColorPalette(std::vector<cv::Scalar>& colors,int nColors){
  * @brief 将网络输出分成 nParts 个图
  * 	前 nBody 个是 heatMap 表示每个 body part 在图中的可能位置
  * 	后 nParts - nBody 个是 PAF 图 表示关节的可能方向
+ * 	只 resize needed[i] 为 true 且还没有 resize 过的图, 其他的保持为空
+ * 	resize 后的图按 heatMapDepth 存储 (CV_8U 时先量化再 resize)
  * @param netOutputBlob 	-> Network Output
  * @param targetSize 		-> Size(hxw) 输入图片的 hxw
+ * @param needed 		-> 需要的通道
  * @param netOutputParts 	-> Vector<Mat> (Return) -> heatMap
+ * @param item 			-> batch 中的第几张图
  */
-void splitNetOutputBlobToParts(cv::Mat& netOutputBlob,const cv::Size& targetSize,std::vector<cv::Mat>& netOutputParts){
+void splitNetOutputBlobToParts(cv::Mat& netOutputBlob,const cv::Size& targetSize,const std::vector<bool>& needed,std::vector<cv::Mat>& netOutputParts,int item){
+	TRACE_SCOPE("splitNetOutputBlobToParts");
 	int nParts = netOutputBlob.size[1];
 	int h = netOutputBlob.size[2];
 	int w = netOutputBlob.size[3];
 
+	netOutputParts.resize(nParts);
 	for(int i = 0; i< nParts;++i){
-		cv::Mat part(h, w, CV_32F, netOutputBlob.ptr(0,i));
+		if(!needed[i] || !netOutputParts[i].empty()){
+			continue;
+		}
+		cv::Mat part(h, w, CV_32F, netOutputBlob.ptr(item,i));
 
 		// cv::imshow(cv::format("HeatMap %d", i), part);
 		// cv::waitKey();
 		cv::Mat resizedPart;
 
-		cv::resize(part,resizedPart,targetSize);
+		if(heatMapDepth == CV_8U){
+			/* Quantize the low resolution plane, the resize then reads and writes 8 bits */
+			double alpha, beta;
+			quantization(i >= nPoints, alpha, beta);
+			cv::Mat compactPart;
+			part.convertTo(compactPart, CV_8U, alpha, beta);
+			cv::resize(compactPart,resizedPart,targetSize);
+		}else if(heatMapDepth == CV_16F){
+			/* resize has no FP16 path, go through one reused FP32 plane */
+			thread_local cv::Mat widePart;
+			cv::resize(part,widePart,targetSize);
+			widePart.convertTo(resizedPart, CV_16F);
+		}else{
+			cv::resize(part,resizedPart,targetSize);
+		}
 
-		netOutputParts.push_back(resizedPart);
+		netOutputParts[i] = resizedPart;
 	}
 }
 
@@ -139,14 +222,15 @@ void populateInterpPoints(const cv::Point& a,const cv::Point& b,int numPoints,st
 /**
  * @brief 分析 body keypoints 之间的关系以及 PAF 得到可能的点对
  * @param netOutputParts 	-> 提供 PAF 
- * @param detectedKeypoints 	-> 每个 body part 的识别到的点
+ * @param candidates 		-> 每个 body part 的识别到的点
  * @param validPairs 		-> 可能的点对
  * @param invalidPairs 		-> 失败的点对的序号
  */
 void getValidPairs(const std::vector<cv::Mat>& netOutputParts,
-		const std::vector<std::vector<KeyPoint>>& detectedKeypoints,
+		const CandidateTable& candidates,
 		std::vector<std::vector<ValidPair>>& validPairs,
 		std::set<int>& invalidPairs) {
+	TRACE_SCOPE("getValidPairs");
 
 	int nInterpSamples = 10;
 	float pafScoreTh = 0.1;
@@ -159,11 +243,13 @@ void getValidPairs(const std::vector<cv::Mat>& netOutputParts,
 		cv::Mat pafB = netOutputParts[mapIdx[k].second];
 
 		//Find the keypoints for the first and second limb
-		const std::vector<KeyPoint>& candA = detectedKeypoints[posePairs[k].first];
-		const std::vector<KeyPoint>& candB = detectedKeypoints[posePairs[k].second];
+		int beginA = candidates.begin(posePairs[k].first);
+		int beginB = candidates.begin(posePairs[k].second);
 
-		int nA = candA.size();
-		int nB = candB.size();
+		int nA = candidates.count(posePairs[k].first);
+		int nB = candidates.count(posePairs[k].second);
+		const int* x = candidates.x.data();
+		const int* y = candidates.y.data();
 
 		/*
 		 * If keypoints for the joint-pair is detected
@@ -176,13 +262,13 @@ void getValidPairs(const std::vector<cv::Mat>& netOutputParts,
 		if(nA != 0 && nB != 0){
 			std::vector<ValidPair> localValidPairs;
 
-			for(int i = 0; i< nA;++i){
+			for(int i = beginA; i< beginA + nA;++i){
 				int maxJ = -1;
 				float maxScore = -1;
 				bool found = false;
 
-				for(int j = 0; j < nB;++j){
-					std::pair<float,float> distance(candB[j].point.x - candA[i].point.x,candB[j].point.y - candA[i].point.y);
+				for(int j = beginB; j < beginB + nB;++j){
+					std::pair<float,float> distance(x[j] - x[i],y[j] - y[i]);
 
 					float norm = std::sqrt(distance.first*distance.first + distance.second*distance.second);
 
@@ -195,14 +281,14 @@ void getValidPairs(const std::vector<cv::Mat>& netOutputParts,
 
 					//Find p(u)
 					std::vector<cv::Point> interpCoords;
-					populateInterpPoints(candA[i].point,candB[j].point,nInterpSamples,interpCoords);
+					populateInterpPoints(cv::Point(x[i],y[i]),cv::Point(x[j],y[j]),nInterpSamples,interpCoords);
 					//Find L(p(u))
 					std::vector<std::pair<float,float>> pafInterp;
 					for(int l = 0; l < interpCoords.size();++l){
 						pafInterp.push_back(
 								std::pair<float,float>(
-									pafA.at<float>(interpCoords[l].y,interpCoords[l].x),
-									pafB.at<float>(interpCoords[l].y,interpCoords[l].x)
+									planeAt(pafA, interpCoords[l].y, interpCoords[l].x, true),
+									planeAt(pafB, interpCoords[l].y, interpCoords[l].x, true)
 									));
 					}
 
@@ -232,7 +318,7 @@ void getValidPairs(const std::vector<cv::Mat>& netOutputParts,
 				}/* j */
 
 				if(found){
-					localValidPairs.push_back(ValidPair(candA[i].id,candB[maxJ].id,maxScore));
+					localValidPairs.push_back(ValidPair(i,maxJ,maxScore));
 				}
 
 			}/* i */
@@ -256,6 +342,7 @@ void getValidPairs(const std::vector<cv::Mat>& netOutputParts,
 void getPersonwiseKeypoints(const std::vector<std::vector<ValidPair>>& validPairs,
 		const std::set<int>& invalidPairs,
 		std::vector<std::vector<int>>& personwiseKeypoints) {
+	TRACE_SCOPE("getPersonwiseKeypoints");
 	for(int k = 0; k < mapIdx.size();++k){
 		if(invalidPairs.find(k) != invalidPairs.end()){
 			continue;
@@ -299,20 +386,105 @@ void getPersonwiseKeypoints(const std::vector<std::vector<ValidPair>>& validPair
 }while(0)
 
 cv::dnn::Net net;
+BlobRecorder recorder;
+std::mutex recorderMutex;
+int recordedFrames = 0;
+
 /**
- * @brief  通过设置初始化网络
+ * @brief 网络输入的大小: 高度固定为 H_in, 宽度按输入图片的比例缩放
+ * @param frameSize 	-> 输入图片大小
  * @param s
- * @return cv::dnn::Net
+ * @return cv::Size
  */
-cv::dnn::Net initNet(Settings s){
-	nPoints = s.nPoints;
-	keypointsMapping = s.keypointsMapping;
-	mapIdx = s.mapIdx;
-	posePairs = s.posePairs;
+cv::Size netInputSize(const cv::Size& frameSize, const Settings& s){
+	return cv::Size((int)((double)s.W_in*(double)frameSize.width/(double)frameSize.height), s.H_in);
+}
+
+int netOutputChannels(const Settings& s){
+	int channels = s.nPoints;
+	for(const std::pair<int,int>& idx : s.mapIdx){
+		channels = std::max(channels, std::max(idx.first, idx.second) + 1);
+	}
+	return channels;
+}
+
+static bool fileNewer(const std::string& a, const std::string& b){
+	struct stat sa, sb;
+	if(stat(a.c_str(), &sa) != 0) return false;
+	if(stat(b.c_str(), &sb) != 0) return true;
+	return sa.st_mtime >= sb.st_mtime;
+}
+
+/**
+ * @brief modelCache 比 modelBin 旧时重新生成 FP16 权重的缓存
+ * 	只在 initNet 中 (所有 worker 开始之前) 调用; 先写临时文件再 rename, loadNet 不会读到写了一半的文件
+ * 	FP16 权重会改变输出, 生成后在一个随机输入上比较两份权重的输出, 差异写进 log
+ */
+static void buildModelCache(const Settings& s){
+	if(s.modelCache.empty() || fileNewer(s.modelCache, s.modelBin)){
+		return;
+	}
+	std::string tmp = cv::format("%s.tmp.%d", s.modelCache.c_str(), (int)getpid());
+	STARTTIME(shrinkStart);
+	cv::dnn::shrinkCaffeModel(s.modelBin, tmp);
+	if(std::rename(tmp.c_str(), s.modelCache.c_str()) != 0){
+		LOG_F(ERROR, "Could not move '%s' to '%s', modelBin is used", tmp.c_str(), s.modelCache.c_str());
+		std::remove(tmp.c_str());
+		return;
+	}
+	ENDTIME("Build Model Cache", shrinkStart);
+	LOG_F(INFO, "Model Cache '%s' Built from '%s'", s.modelCache.c_str(), s.modelBin.c_str());
+
+	cv::Size inputSize = netInputSize(cv::Size(s.warmupWidth, s.warmupHeight), s);
+	int shape[] = {1, 3, inputSize.height, inputSize.width};
+	cv::Mat inputBlob(4, shape, CV_32F);
+	cv::randu(inputBlob, 0.f, 1.f);
+	cv::dnn::Net full = cv::dnn::readNetFromCaffe(s.modelTxt, s.modelBin);
+	cv::dnn::Net half = cv::dnn::readNetFromCaffe(s.modelTxt, s.modelCache);
+	full.setInput(inputBlob);
+	cv::Mat a = full.forward().reshape(1, 1);
+	half.setInput(inputBlob);
+	cv::Mat b = half.forward().reshape(1, 1);
+	cv::Mat diff;
+	cv::absdiff(a, b, diff);
+	double maxDiff;
+	cv::minMaxLoc(diff, 0, &maxDiff);
+	LOG_F(INFO, "Model Cache: FP16 weights change the network output by max %.5f, mean %.6f (keypoint threshold %.2f)",
+			maxDiff, cv::mean(diff)[0], heatMapThresh);
+}
 
-	net = cv::dnn::readNetFromCaffe(s.modelTxt, s.modelBin);
+/**
+ * @brief 读取 Caffe 模型, modelCache 已经生成 (buildModelCache) 时使用 FP16 权重的缓存
+ * 	OpenCV 没有 Caffe 网络的序列化格式, 缓存只能减少权重的读取和解析量 (约一半)
+ */
+static cv::dnn::Net readModel(const Settings& s){
+	if(!s.modelCache.empty() && fileNewer(s.modelCache, s.modelBin)){
+		return cv::dnn::readNetFromCaffe(s.modelTxt, s.modelCache);
+	}
+	return cv::dnn::readNetFromCaffe(s.modelTxt, s.modelBin);
+}
 
-	if(s.device=="CPU"){
+/**
+ * @brief  按设置读取模型并选择设备, 每次调用得到一个独立的网络
+ * 	warmup > 0 时在返回前按 warmupWidth x warmupHeight 的输入跑几次网络,
+ * 	让各层的 buffer 在第一帧之前分配好
+ * @param s
+ * @return cv::dnn::Net
+ */
+cv::dnn::Net loadNet(const Settings& s){
+	STARTTIME(loadStart);
+	cv::dnn::Net net = readModel(s);
+	ENDTIME("Read Model", loadStart);
+
+	if(s.dnnBackend >= 0){
+		LOG_F(INFO, "Using Autotuned Backend %d / Target %d", s.dnnBackend, s.dnnTarget);
+		net.setPreferableBackend(s.dnnBackend);
+		net.setPreferableTarget(s.dnnTarget);
+		net.enableFusion(s.dnnFusion);
+#if OPENPOSE_HAS_WINOGRAD
+		net.enableWinograd(s.dnnWinograd);
+#endif
+	}else if(s.device=="CPU"){
 		LOG_F(INFO, "Using CPU Device");
 		net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
 		net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
@@ -322,96 +494,428 @@ cv::dnn::Net initNet(Settings s){
 		net.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
 	}
 
+	if(s.warmup > 0){
+		cv::Size inputSize = netInputSize(cv::Size(s.warmupWidth, s.warmupHeight), s);
+		int shape[] = {1, 3, inputSize.height, inputSize.width};
+		cv::Mat inputBlob(4, shape, CV_32F, cv::Scalar(0));
+		for(int i = 0; i < s.warmup; ++i){
+			STARTTIME(warmupStart);
+			net.setInput(inputBlob);
+			net.forward();
+			ENDTIME(cv::format("Warm-up Forward %d (%dx%d)", i, inputSize.width, inputSize.height).c_str(), warmupStart);
+		}
+	}
+	ENDTIME("Load Net", loadStart);
+	return net;
+}
+
+/**
+ * @brief  通过设置初始化网络
+ * @param s
+ * @return cv::dnn::Net
+ */
+cv::dnn::Net initNet(Settings s){
+	STARTTIME(initStart);
+	nPoints = s.nPoints;
+	keypointsMapping = s.keypointsMapping;
+	mapIdx = s.mapIdx;
+	posePairs = s.posePairs;
+	heatMapDepth = s.heatmapPrecision=="U8" ? CV_8U : (s.heatmapPrecision=="FP16" ? CV_16F : CV_32F);
+	LOG_F(INFO, "HeatMap Precision: %s", s.heatmapPrecision.c_str());
+	singlePerson = s.singlePerson;
+	if(singlePerson){
+		LOG_F(INFO, "Single Person Mode: PAFs Not Used");
+	}
+
 	populateColorPalette(colors,nPoints);
 
+	if(!s.recordFile.empty()){
+		recorder.open(s.recordFile, s.nPoints);
+	}
+
+	if(s.type==REPLAY || s.type==VERIFY || s.type==CLIENT){
+		/* Recorded / synthetic blobs go straight into postProcess, no weights needed */
+		LOG_F(INFO, "%s Mode, Network Not Loaded", s.inputType.c_str());
+		return net;
+	}
+	/* Before any worker calls loadNet, the cache file is written by this thread only */
+	buildModelCache(s);
+	if(s.type==BATCH || s.type==MULTI || s.type==SERVER){
+		/* Every worker loads its own network with loadNet */
+		LOG_F(INFO, "%s Mode, Network Loaded per Worker", s.inputType.c_str());
+		return net;
+	}
+
+	net = loadNet(s);
+	if(s.detectHands){
+		handNet(s);
+	}
+
+	ENDTIME("Init Net", initStart);
 	LOG_F(INFO, "Init Net Complete");
 
 	return net;
 }
 
 /**
- * @brief 跑一次网络，输出含有标记的图片
+ * @brief net.forward 加上所有前向共用的部分: trace, forward 延迟, layerProfile, recordFile
+ * @param net 		-> 由 loadNet 得到的网络 (不可多线程共用)
+ * @param inputBlob 	-> N x 3 x H x W
+ * @param frameSizes 	-> 每一张 (N 张) 对应的原图大小, 录制时写进 record; 空 = 不录制 (coarse, ROI, tile)
+ * @param name 		-> trace 的名字 (字符串常量)
+ * @return 		netOutputBlob (N x C x H x W)
+ */
+cv::Mat forwardBlob(cv::dnn::Net& net, const cv::Mat& inputBlob, const std::vector<cv::Size>& frameSizes, const char* name){
+	static Histogram& forwardLatency = stageHistogram("forward");
+	net.setInput(inputBlob);
+	cv::Mat netOutputBlob;
+	{
+		TRACE_SCOPE(name);
+		StageLatency latency(forwardLatency);
+		netOutputBlob = net.forward();
+	}
+	if(layerProfileOn.load(std::memory_order_relaxed)){
+		layerProfileCollect(net);
+	}
+
+	if(recorder.isOpened() && !frameSizes.empty()){
+		/* One record per image, a batch item is a 1 x C x H x W view */
+		int shape[] = {1, netOutputBlob.size[1], netOutputBlob.size[2], netOutputBlob.size[3]};
+		std::lock_guard<std::mutex> lock(recorderMutex);
+		for(int i = 0; i < netOutputBlob.size[0] && i < (int)frameSizes.size();++i){
+			recorder.write(recordedFrames++, frameSizes[i], cv::Mat(4, shape, CV_32F, netOutputBlob.ptr(i)));
+		}
+	}
+	return netOutputBlob;
+}
+
+/**
+ * @brief 只跑网络, 返回 netOutputBlob (N x C x H x W)
+ * @param net   由 loadNet 得到的网络 (不可多线程共用)
  * @param input cv::Mat
+ * @param s     Settings
  * @return  	cv::Mat
  */
-cv::Mat forwardNet(cv::Mat input, Settings s){
-	LOG_F(1, ">>>>>>>>>>>>>>>>>>>> Network START");
-
-	cv::Mat inputBlob = cv::dnn::blobFromImage(input, s.scale, cv::Size((int)((double)s.W_in*(double)input.cols/(double)input.rows), s.H_in), cv::Scalar(0, 0, 0), false, false);
+cv::Mat inferNet(cv::dnn::Net& net, const cv::Mat& input, const Settings& s){
+	TRACE_SCOPE("inferNet");
+	cv::Mat inputBlob;
+	{
+		TRACE_SCOPE("blobFromImage");
+		inputBlob = cv::dnn::blobFromImage(input, s.scale, netInputSize(input.size(), s), cv::Scalar(0, 0, 0), false, false);
+	}
 
 	LOG_F(1, "%d x %d",input.cols, input.rows);
 
-	net.setInput(inputBlob);
-	LOG_F(1, "Input Prepared");
-
-	cv::Mat netOutputBlob = net.forward();
+	cv::Mat netOutputBlob = forwardBlob(net, inputBlob, {input.size()}, "forward");
 	LOG_F(1, "Forward Completed");
 
-	std::vector<cv::Mat> netOutputParts;
-	splitNetOutputBlobToParts(netOutputBlob,cv::Size(input.cols,input.rows),netOutputParts);
-	LOG_F(1, "Output Split Completed");
-	LOG_F(1, "OUTPUT SIZE: %ld",netOutputParts.size());
+	return netOutputBlob;
+}
 
-	int keyPointId = 0;
-	std::vector<std::vector<KeyPoint>> detectedKeypoints;
-	std::vector<KeyPoint> keyPointsList;
+cv::Mat inferNet(const cv::Mat& input, const Settings& s){
+	return inferNet(net, input, s);
+}
 
-	for(int i = 0; i < nPoints;++i){
-		std::vector<KeyPoint> keyPoints;
+/**
+ * @brief 峰值附近用抛物线拟合, 返回亚像素偏移 (-0.5 ~ 0.5)
+ * @param l 	-> 左 (上) 邻居
+ * @param c 	-> 峰值
+ * @param r 	-> 右 (下) 邻居
+ */
+static inline float quadraticPeakOffset(float l, float c, float r){
+	float d = l - 2 * c + r;
+	if(d >= 0) return 0; 	// flat, no curvature to fit
+	return std::max(-0.5f, std::min(0.5f, 0.5f * (l - r) / d));
+}
 
-		getKeyPoints(netOutputParts[i],0.1,keyPoints);
+/**
+ * @brief singlePerson 的后处理: 在低分辨率的 heatMap 上取每个 part 的最大值 (亚像素),
+ * 	直接组成一个人, 不 resize, 不读 PAF
+ * 	至少有一对 posePairs 两端都找到才算有人
+ */
+static void singlePersonPostProcess(cv::Mat& netOutputBlob, const cv::Size& targetSize, PoseResult& result, int item){
+	TRACE_SCOPE("singlePerson");
+	int h = netOutputBlob.size[2];
+	int w = netOutputBlob.size[3];
+	float sx = (float)targetSize.width / w;
+	float sy = (float)targetSize.height / h;
 
-		// std::cout << "Keypoints - " << keypointsMapping[i] << " : " << keyPoints << std::endl;
+	CandidateTable& candidates = result.candidates;
+	candidates.reset(0);
+	std::vector<int> person(nPoints, -1);
+	for(int i = 0; i < nPoints;++i){
+		candidates.beginPart();
+		cv::Mat heatMap(h, w, CV_32F, netOutputBlob.ptr(item,i));
+		double maxVal;
+		cv::Point maxLoc;
+		cv::minMaxLoc(heatMap, 0, &maxVal, 0, &maxLoc);
+		if(maxVal <= heatMapThresh) continue;
 
-		for(int i = 0; i< keyPoints.size();++i,++keyPointId){
-			keyPoints[i].id = keyPointId;
+		float dx = 0, dy = 0;
+		if(maxLoc.x > 0 && maxLoc.x < w - 1){
+			const float* row = heatMap.ptr<float>(maxLoc.y);
+			dx = quadraticPeakOffset(row[maxLoc.x - 1], row[maxLoc.x], row[maxLoc.x + 1]);
 		}
+		if(maxLoc.y > 0 && maxLoc.y < h - 1){
+			dy = quadraticPeakOffset(heatMap.at<float>(maxLoc.y - 1, maxLoc.x), heatMap.at<float>(maxLoc.y, maxLoc.x), heatMap.at<float>(maxLoc.y + 1, maxLoc.x));
+		}
+		/* Same pixel centre mapping as cv::resize */
+		int x = cvRound((maxLoc.x + dx + 0.5f) * sx - 0.5f);
+		int y = cvRound((maxLoc.y + dy + 0.5f) * sy - 0.5f);
+		cv::Point p(std::max(0, std::min(targetSize.width - 1, x)), std::max(0, std::min(targetSize.height - 1, y)));
+		person[i] = candidates.push(p, (float)maxVal);
+	}
 
-		detectedKeypoints.push_back(keyPoints);
-		keyPointsList.insert(keyPointsList.end(),keyPoints.begin(),keyPoints.end());
+	result.personwiseKeypoints.clear();
+	for(const std::pair<int,int>& pair : posePairs){
+		if(person[pair.first] != -1 && person[pair.second] != -1){
+			result.personwiseKeypoints.push_back(person);
+			break;
+		}
 	}
-	LOG_F(1, "Key Points Extracted");
+	LOG_F(1, "Single Person: %d/%d Parts", candidates.size(), nPoints);
+}
 
+/**
+ * @brief 从 netOutputBlob 中解析出每个人的骨架 (不需要网络)
+ * @param netOutputBlob 	-> Network Output
+ * @param targetSize 		-> 输入图片的大小
+ * @param result 		-> 返回值
+ * @param item 			-> batch 中的第几张图
+ */
+void postProcess(cv::Mat& netOutputBlob, const cv::Size& targetSize, PoseResult& result, int item){
+	TRACE_SCOPE("postProcess");
+	static Histogram& postProcessLatency = stageHistogram("postprocess");
+	StageLatency latency(postProcessLatency);
+	if(singlePerson){
+		singlePersonPostProcess(netOutputBlob, targetSize, result, item);
+		return;
+	}
+	int nParts = netOutputBlob.size[1];
+	int h = netOutputBlob.size[2];
+	int w = netOutputBlob.size[3];
 
-	cv::Mat outputFrame = input.clone();
+	/*
+	 * Resize and blur never raise the maximum of a channel (both are convex
+	 * combinations), so a heatMap whose low resolution max is not above the
+	 * threshold can not produce a keypoint and is skipped entirely
+	 */
+	std::vector<bool> needed(nParts, false);
+	int nSkipped = 0;
+	for(int i = 0; i < nPoints;++i){
+		double maxVal;
+		cv::minMaxLoc(cv::Mat(h, w, CV_32F, netOutputBlob.ptr(item,i)), 0, &maxVal);
+		needed[i] = maxVal > heatMapThresh;
+		nSkipped += !needed[i];
+	}
+
+	std::vector<cv::Mat> netOutputParts;
+	splitNetOutputBlobToParts(netOutputBlob,targetSize,needed,netOutputParts,item);
+	LOG_F(1, "HeatMap Split Completed, %d/%d Empty", nSkipped, nPoints);
+
+	/* Candidates are written once, part by part, ids are their index in the table */
+	CandidateTable& candidates = result.candidates;
+	candidates.reset(0);
 
-	/* 将识别到的 Points 在图上标出来 */
 	for(int i = 0; i < nPoints;++i){
-		for(int j = 0; j < detectedKeypoints[i].size();++j){
-			cv::circle(outputFrame,detectedKeypoints[i][j].point,5,colors[i],-1,cv::LINE_AA);
+		candidates.beginPart();
+		if(needed[i]){
+			getKeyPoints(netOutputParts[i],heatMapThresh,candidates);
+		}
+	}
+	LOG_F(1, "Key Points Extracted");
+
+	/* PAFs are only read for limbs whose both ends have candidates */
+	std::fill(needed.begin(), needed.end(), false);
+	int nPafs = 0;
+	for(int k = 0; k < mapIdx.size();++k){
+		if(candidates.count(posePairs[k].first) && candidates.count(posePairs[k].second)){
+			needed[mapIdx[k].first] = needed[mapIdx[k].second] = true;
+			nPafs += 2;
 		}
 	}
+	splitNetOutputBlobToParts(netOutputBlob,targetSize,needed,netOutputParts,item);
+	LOG_F(1, "PAF Split Completed, %d/%d Used", nPafs, (int)(2*mapIdx.size()));
 
 	std::vector<std::vector<ValidPair>> validPairs;
 	std::set<int> invalidPairs;
-	getValidPairs(netOutputParts,detectedKeypoints,validPairs,invalidPairs);
+	getValidPairs(netOutputParts,candidates,validPairs,invalidPairs);
 	LOG_F(1, "Points Paired");
 
-	std::vector<std::vector<int>> personwiseKeypoints;
-	getPersonwiseKeypoints(validPairs,invalidPairs,personwiseKeypoints);
+	getPersonwiseKeypoints(validPairs,invalidPairs,result.personwiseKeypoints);
 	LOG_F(1, "Person Points Detected");
+}
+
+/**
+ * @brief 把 src 的结果 (平移 offset 后) 追加到 dst, 重新编号
+ * @param dst
+ * @param src
+ * @param offset 	-> src 坐标系原点在 dst 坐标系中的位置
+ */
+void mergePoseResult(PoseResult& dst, const PoseResult& src, const cv::Point& offset){
+	/* Candidates stay grouped by part, so both tables are interleaved part by part and renumbered */
+	const CandidateTable& a = dst.candidates;
+	const CandidateTable& b = src.candidates;
+	CandidateTable merged;
+	merged.reset(0);
+	std::vector<int> newIdA(a.size()), newIdB(b.size());
+	for(int i = 0; i < nPoints;++i){
+		merged.beginPart();
+		if(i < a.nParts()){
+			for(int j = a.begin(i); j < a.end(i);++j){
+				newIdA[j] = merged.push(a.point(j), a.score[j]);
+			}
+		}
+		if(i < b.nParts()){
+			for(int j = b.begin(i); j < b.end(i);++j){
+				newIdB[j] = merged.push(b.point(j) + offset, b.score[j]);
+			}
+		}
+	}
+	for(std::vector<int>& person : dst.personwiseKeypoints){
+		for(int& id : person){
+			if(id != -1) id = newIdA[id];
+		}
+	}
+	dst.candidates = std::move(merged);
+
+	for(HandResult hand : src.hands){
+		hand.person += dst.personwiseKeypoints.size();
+		hand.box += offset;
+		for(cv::Point& p : hand.points){
+			if(p.x >= 0) p += offset;
+		}
+		dst.hands.push_back(hand);
+	}
+	for(std::vector<int> person : src.personwiseKeypoints){
+		for(int& id : person){
+			if(id != -1) id = newIdB[id];
+		}
+		dst.personwiseKeypoints.push_back(person);
+	}
+}
+
+/**
+ * @brief 按设置选择检测方式 (单次 / 两次 coarse-to-fine / 分块), 得到原图坐标下的结果
+ * 	detectHands 时再用身体的结果检测手
+ * @param net 	-> 由 loadNet 得到的网络
+ * @param input
+ * @param s
+ * @param result 	-> 返回值
+ */
+void detectPose(cv::dnn::Net& net, const cv::Mat& input, const Settings& s, PoseResult& result){
+	TRACE_SCOPE("detectPose");
+	if(s.tileSize > 0 && (input.cols > s.tileSize || input.rows > s.tileSize)){
+		tiledPose(net, input, s, result);
+	}else if(s.twoPass){
+		twoPassPose(net, input, s, result);
+	}else{
+		cv::Mat netOutputBlob = inferNet(net, input, s);
+		postProcess(netOutputBlob, input.size(), result);
+	}
+	completePose(input, s, result);
+}
+
+/**
+ * @brief detectPose 在身体的结果之后的部分: detectHands 时检测手, 记录每帧的指标
+ * @param input
+ * @param s
+ * @param result 	-> 身体的结果, 补上 hands
+ */
+void completePose(const cv::Mat& input, const Settings& s, PoseResult& result){
+	if(s.detectHands){
+		static Histogram& handsLatency = stageHistogram("hands");
+		StageLatency latency(handsLatency);
+		detectHands(input, result, s, result.hands);
+	}
+
+	static Histogram& people = metricsHistogram("openpose_people_per_frame", "", "People detected in a frame", {0, 1, 2, 3, 5, 8, 13, 21, 34});
+	static Histogram& candidates = metricsHistogram("openpose_candidates_per_frame", "", "Keypoint candidates in a frame", {0, 10, 25, 50, 100, 250, 500, 1000});
+	people.observe(result.personwiseKeypoints.size());
+	candidates.observe(result.candidates.size());
+}
+
+void detectPose(const cv::Mat& input, const Settings& s, PoseResult& result){
+	detectPose(net, input, s, result);
+}
+
+static inline cv::Point scalePoint(const cv::Point& p, double scale){
+	return scale == 1.0 ? p : cv::Point(cvRound(p.x*scale), cvRound(p.y*scale));
+}
+
+/**
+ * @brief 在 frame 上画出 result (直接画在 frame 上)
+ * @param frame 	-> 被画的图片
+ * @param result 	-> postProcess 的结果
+ * @param antiAlias 	-> false 时用 LINE_8, 大图上快很多
+ * @param scale 	-> frame 相对于 result 坐标的缩放 (预览图)
+ */
+void renderPose(cv::Mat& frame, const PoseResult& result, bool antiAlias, double scale){
+	TRACE_SCOPE("renderPose");
+	static Histogram& renderLatency = stageHistogram("render");
+	StageLatency latency(renderLatency);
+	int lineType = antiAlias ? cv::LINE_AA : cv::LINE_8;
+	int radius = std::max(1, cvRound(5*scale));
+	int thickness = std::max(1, cvRound(3*scale));
+
+	/* 将识别到的 Points 在图上标出来 */
+	const CandidateTable& candidates = result.candidates;
+	for(int i = 0; i < candidates.nParts();++i){
+		for(int j = candidates.begin(i); j < candidates.end(i);++j){
+			cv::circle(frame,scalePoint(candidates.point(j),scale),radius,colors[i],-1,lineType);
+		}
+	}
 
 	/* 绘图 */
 	for(int i = 0; i< nPoints-1;++i){
-		for(int n  = 0; n < personwiseKeypoints.size();++n){
+		for(int n  = 0; n < result.personwiseKeypoints.size();++n){
 			const std::pair<int,int>& posePair = posePairs[i];
-			int indexA = personwiseKeypoints[n][posePair.first];
-			int indexB = personwiseKeypoints[n][posePair.second];
+			int indexA = result.personwiseKeypoints[n][posePair.first];
+			int indexB = result.personwiseKeypoints[n][posePair.second];
 
 			if(indexA == -1 || indexB == -1){
 				continue;
 			}
 
-			const KeyPoint& kpA = keyPointsList[indexA];
-			const KeyPoint& kpB = keyPointsList[indexB];
-
-			cv::line(outputFrame,kpA.point,kpB.point,colors[i],3,cv::LINE_AA);
+			cv::line(frame,scalePoint(candidates.point(indexA),scale),scalePoint(candidates.point(indexB),scale),colors[i],thickness,lineType);
 
 		}
 	}
+
+	renderHands(frame, result.hands, antiAlias, scale);
+}
+
+/**
+ * @brief 缩小到 previewWidth 宽再画 result, 原图不动
+ * @param frame 	-> 原图 (不会被修改)
+ * @param result 	-> postProcess 的结果 (原图坐标)
+ * @param s 		-> previewWidth, renderFast
+ * @return cv::Mat 	预览图
+ */
+cv::Mat renderPreview(const cv::Mat& frame, const PoseResult& result, const Settings& s){
+	double scale = (double)s.previewWidth / (double)frame.cols;
+	cv::Mat preview;
+	cv::resize(frame, preview, cv::Size(), scale, scale, s.renderFast ? cv::INTER_NEAREST : cv::INTER_AREA);
+	renderPose(preview, result, !s.renderFast, scale);
+	return preview;
+}
+
+/**
+ * @brief 跑一次网络，输出含有标记的图片
+ * @param input cv::Mat
+ * @return  	cv::Mat
+ */
+cv::Mat forwardNet(cv::Mat input, Settings s){
+	LOG_F(1, ">>>>>>>>>>>>>>>>>>>> Network START");
+
+	PoseResult result;
+	detectPose(input, s, result);
+
+	/* input shares the caller's buffer, renderInPlace draws on it directly */
+	cv::Mat outputFrame = s.renderInPlace ? input : input.clone();
+	renderPose(outputFrame, result, !s.renderFast);
 	LOG_F(1, "Output Frame Drawn");
 	LOG_F(1, "<<<<<<<<<<<<<<<<<<<< Network Finished");
 
 	return outputFrame;
 }
-
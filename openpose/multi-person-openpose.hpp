@@ -1,3 +1,6 @@
+#ifndef __MULTI_PERSON_OPENPOSE__H__
+#define __MULTI_PERSON_OPENPOSE__H__
+
 #include<opencv2/dnn.hpp>
 #include<opencv2/imgproc.hpp>
 #include<opencv2/highgui.hpp>
@@ -9,6 +12,7 @@
 #include<cmath>
 
 #include "../include/settings.hpp"
+#include "hand-pose.hpp"
 #include "../logsrc/loguru.hpp"
 
 
@@ -37,6 +41,64 @@ struct ValidPair{
 	float score;
 };
 
+/**
+ * @brief 一帧所有的候选点 (structure of arrays), 检测时写一次, 配对 / 组装 / 输出都直接读
+ * 	候选点的下标即它的 id
+ * 	part i 的候选点是 [partOffset[i], partOffset[i+1])
+ */
+struct CandidateTable{
+	std::vector<int> x;
+	std::vector<int> y;
+	std::vector<float> score;
+	std::vector<int> partOffset; 	// nParts + 1
+
+	/**
+	 * @brief 清空并设为 nParts 个空的 part
+	 */
+	void reset(int nParts){
+		x.clear();
+		y.clear();
+		score.clear();
+		partOffset.assign(nParts + 1, 0);
+	}
+	/**
+	 * @brief 开始写下一个 part (reset(0) 之后按 part 顺序调用 beginPart / push)
+	 */
+	void beginPart(){
+		partOffset.push_back(size());
+	}
+	/**
+	 * @brief 给最后一个 part 加一个候选点
+	 * @return 候选点的 id
+	 */
+	int push(const cv::Point& p, float probability){
+		x.push_back(p.x);
+		y.push_back(p.y);
+		score.push_back(probability);
+		partOffset.back() = size();
+		return size() - 1;
+	}
+
+	int size() const { return x.size(); }
+	int nParts() const { return partOffset.empty() ? 0 : partOffset.size() - 1; }
+	int begin(int part) const { return partOffset[part]; }
+	int end(int part) const { return partOffset[part + 1]; }
+	int count(int part) const { return end(part) - begin(part); }
+	cv::Point point(int id) const { return cv::Point(x[id], y[id]); }
+};
+
+/**
+ * @brief 一帧的后处理结果
+ * 	candidates 		-> 所有 body part 的候选点
+ * 	personwiseKeypoints 	-> 每个人每个 part 对应的候选点 id (-1 表示没有)
+ * 	hands 			-> detectHands 时每只手的结果
+ */
+struct PoseResult{
+	CandidateTable candidates;
+	std::vector<std::vector<int>> personwiseKeypoints;
+	std::vector<HandResult> hands;
+};
+
 /**
  * @brief 跑一次网络，输出含有标记的图片
  * @param input cv::Mat
@@ -51,3 +113,116 @@ cv::Mat forwardNet(cv::Mat input, Settings s);
  * @return cv::dnn::Net
  */
 cv::dnn::Net initNet(Settings s);
+
+/**
+ * @brief 网络输入的大小: 高度固定为 H_in, 宽度按输入图片的比例缩放
+ * @param frameSize 	-> 输入图片大小
+ * @param s
+ * @return cv::Size
+ */
+cv::Size netInputSize(const cv::Size& frameSize, const Settings& s);
+
+/**
+ * @brief postProcess 读到的 netOutputBlob 通道数: heatMaps (nPoints) 和 mapIdx 中的 PAFs
+ * @param s
+ * @return int
+ */
+int netOutputChannels(const Settings& s);
+
+/**
+ * @brief  按设置读取模型并选择设备, 每次调用得到一个独立的网络
+ * 	(modelCache -> FP16 权重缓存, warmup -> 预热次数)
+ * @param s
+ * @return cv::dnn::Net
+ */
+cv::dnn::Net loadNet(const Settings& s);
+
+/**
+ * @brief net.forward 加上所有前向共用的部分: trace, forward 延迟, layerProfile, recordFile
+ * 	单帧, coarse-to-fine 和动态 batch 的前向都经过这里
+ * @param net 		-> 由 loadNet 得到的网络
+ * @param inputBlob 	-> N x 3 x H x W
+ * @param frameSizes 	-> 每一张 (N 张) 对应的原图大小, 录制时写进 record; 空 = 不录制 (coarse, ROI, tile)
+ * @param name 		-> trace 的名字 (字符串常量)
+ * @return 		netOutputBlob (N x C x H x W)
+ */
+cv::Mat forwardBlob(cv::dnn::Net& net, const cv::Mat& inputBlob, const std::vector<cv::Size>& frameSizes, const char* name);
+
+/**
+ * @brief 用指定的网络跑一次, 返回 netOutputBlob (N x C x H x W)
+ * 	一个 cv::dnn::Net 同一时间只能被一个线程使用
+ * @param net   由 loadNet 得到的网络
+ * @param input cv::Mat
+ * @param s     Settings
+ * @return  	cv::Mat
+ */
+cv::Mat inferNet(cv::dnn::Net& net, const cv::Mat& input, const Settings& s);
+
+/**
+ * @brief 只跑网络 (initNet 初始化的网络), 返回 netOutputBlob (N x C x H x W)
+ * @param input cv::Mat
+ * @param s     Settings
+ * @return  	cv::Mat
+ */
+cv::Mat inferNet(const cv::Mat& input, const Settings& s);
+
+/**
+ * @brief 从 netOutputBlob 中解析出每个人的骨架 (不需要网络)
+ * @param netOutputBlob 	-> Network Output
+ * @param targetSize 		-> 输入图片的大小
+ * @param result 		-> 返回值
+ * @param item 			-> batch 中的第几张图
+ */
+void postProcess(cv::Mat& netOutputBlob, const cv::Size& targetSize, PoseResult& result, int item = 0);
+
+/**
+ * @brief 把 src 的结果 (平移 offset 后) 追加到 dst, 重新编号
+ * @param dst
+ * @param src
+ * @param offset 	-> src 坐标系原点在 dst 坐标系中的位置
+ */
+void mergePoseResult(PoseResult& dst, const PoseResult& src, const cv::Point& offset);
+
+/**
+ * @brief 按设置选择检测方式 (单次 / 两次 coarse-to-fine / 分块), 得到原图坐标下的结果
+ * 	detectHands 时再用身体的结果检测手
+ * @param net 	-> 由 loadNet 得到的网络
+ * @param input
+ * @param s
+ * @param result 	-> 返回值
+ */
+void detectPose(cv::dnn::Net& net, const cv::Mat& input, const Settings& s, PoseResult& result);
+
+/**
+ * @brief 同上, 使用 initNet 初始化的网络
+ */
+void detectPose(const cv::Mat& input, const Settings& s, PoseResult& result);
+
+/**
+ * @brief detectPose 在身体的结果之后的部分: detectHands 时检测手, 记录每帧的指标
+ * 	自己做推理和 postProcess 的调用者 (e.g. DynamicBatcher) 用它补全结果
+ * @param input
+ * @param s
+ * @param result 	-> 身体的结果, 补上 hands
+ */
+void completePose(const cv::Mat& input, const Settings& s, PoseResult& result);
+
+/**
+ * @brief 在 frame 上画出 result (直接画在 frame 上)
+ * @param frame 	-> 被画的图片
+ * @param result 	-> postProcess 的结果
+ * @param antiAlias 	-> false 时用 LINE_8, 大图上快很多
+ * @param scale 	-> frame 相对于 result 坐标的缩放 (预览图)
+ */
+void renderPose(cv::Mat& frame, const PoseResult& result, bool antiAlias = true, double scale = 1.0);
+
+/**
+ * @brief 缩小到 previewWidth 宽再画 result, 原图不动
+ * @param frame 	-> 原图 (不会被修改)
+ * @param result 	-> postProcess 的结果 (原图坐标)
+ * @param s 		-> previewWidth, renderFast
+ * @return cv::Mat 	预览图
+ */
+cv::Mat renderPreview(const cv::Mat& frame, const PoseResult& result, const Settings& s);
+
+#endif
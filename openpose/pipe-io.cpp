@@ -0,0 +1,105 @@
+#include "pipe-io.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "thread-budget.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<cstring>
+
+#include<signal.h>
+
+bool PipeReader::open(int fd, const cv::Size& frameSize, size_t queueCapacity){
+	close();
+	this->fd = fd;
+	frames.reset(new BlockingQueue<cv::Mat>(queueCapacity));
+	reader = std::thread([this, frameSize]{
+		pinThread(STAGE_IO);
+		static Gauge& depth = metricsGauge("openpose_queue_depth", "queue=\"pipe_in\"", "Frames waiting in a queue");
+		size_t bytes = (size_t)frameSize.width * frameSize.height * 3;
+		int64_t count = 0;
+		while(true){
+			cv::Mat frame(frameSize, CV_8UC3);
+			bool complete;
+			{
+				TRACE_SCOPE("pipeRead");
+				complete = readFull(this->fd, frame.data, bytes);
+			}
+			if(!complete || !frames->push(frame)) break;
+			depth.set(frames->size());
+			++count;
+		}
+		LOG_F(INFO, "Pipe: end of input after %lld frames", (long long)count);
+		frames->close();
+	});
+	return true;
+}
+
+bool PipeReader::read(cv::Mat& frame){
+	return frames && frames->pop(frame);
+}
+
+void PipeReader::close(){
+	if(frames){
+		frames->close();
+	}
+	if(reader.joinable()){
+		reader.join();
+	}
+	frames.reset();
+	fd = -1;
+}
+
+bool PipeWriter::open(int fd, size_t queueCapacity){
+	close();
+	/* A closed downstream shows up as EPIPE on write instead of killing the process */
+	signal(SIGPIPE, SIG_IGN);
+	this->fd = fd;
+	chunks.reset(new BlockingQueue<cv::Mat>(queueCapacity));
+	writer = std::thread([this]{
+		pinThread(STAGE_IO);
+		static Gauge& depth = metricsGauge("openpose_queue_depth", "queue=\"pipe_out\"", "Frames waiting in a queue");
+		cv::Mat chunk;
+		bool ok = true;
+		while(chunks->pop(chunk)){
+			depth.set(chunks->size());
+			if(!ok) continue; 	// downstream is gone, drain and drop
+			TRACE_SCOPE("pipeWrite");
+			size_t rowBytes = chunk.cols * chunk.elemSize();
+			if(chunk.isContinuous()){
+				ok = writeFull(this->fd, chunk.data, rowBytes * chunk.rows);
+			}else{
+				for(int y = 0; y < chunk.rows && ok;++y){
+					ok = writeFull(this->fd, chunk.ptr(y), rowBytes);
+				}
+			}
+			if(!ok){
+				LOG_F(ERROR, "Pipe: output closed, the rest is dropped");
+			}
+		}
+	});
+	return true;
+}
+
+void PipeWriter::writeFrame(const cv::Mat& frame){
+	chunks->push(frame);
+}
+
+void PipeWriter::writeKeypoints(int64_t frameIndex, int nParts, int nPeople, const std::vector<PoseKeypointRecord>& records){
+	size_t payload = sizeof(PoseKeypointRecord) * records.size();
+	cv::Mat chunk(1, (int)(sizeof(PipeKeypointHeader) + payload), CV_8U);
+	PipeKeypointHeader header = {PIPE_KEYPOINT_MAGIC, (uint32_t)nParts, frameIndex, (uint32_t)nPeople, 0};
+	std::memcpy(chunk.data, &header, sizeof(header));
+	std::memcpy(chunk.data + sizeof(header), records.data(), payload);
+	chunks->push(chunk);
+}
+
+void PipeWriter::close(){
+	if(chunks){
+		chunks->close();
+	}
+	if(writer.joinable()){
+		writer.join();
+	}
+	chunks.reset();
+	fd = -1;
+}
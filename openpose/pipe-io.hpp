@@ -0,0 +1,83 @@
+#ifndef __PIPE_IO__H__
+#define __PIPE_IO__H__
+
+#include "blocking-queue.hpp"
+#include "pose-wire.hpp"
+
+#include<opencv2/core.hpp>
+
+#include<cstdint>
+#include<memory>
+#include<thread>
+#include<vector>
+
+/*
+ * PIPE mode, e.g.
+ * 	ffmpeg -i in.mp4 -vf scale=1280:720 -f rawvideo -pix_fmt bgr24 - | ./run PIPE.xml | ffmpeg -f rawvideo -pix_fmt bgr24 -s 1280x720 -i - out.mp4
+ * stdin 	-> pipeWidth x pipeHeight x 3 bytes per frame (BGR, no padding)
+ * stdout 	-> pipeOutput FRAMES: the rendered frames, same layout as stdin
+ * 		   pipeOutput KEYPOINTS: per frame PipeKeypointHeader + nPeople x nParts PoseKeypointRecord
+ * Logs go to stderr only.
+ */
+struct PipeKeypointHeader{
+	uint32_t magic; 	// 0x504B504F 'OPKP'
+	uint32_t nParts;
+	int64_t frameIndex;
+	uint32_t nPeople;
+	uint32_t reserved;
+};
+
+const uint32_t PIPE_KEYPOINT_MAGIC = 0x504B504F;
+
+/**
+ * @brief 在单独的线程里从 fd 读取定长的 BGR 帧, 上游 (ffmpeg) 不会因为推理而阻塞
+ */
+class PipeReader{
+	public:
+		PipeReader():fd(-1){}
+		~PipeReader(){ close(); }
+
+		bool open(int fd, const cv::Size& frameSize, size_t queueCapacity);
+		/**
+		 * @brief 取下一帧 (每帧一个新的 buffer)
+		 * @return false 	-> EOF
+		 */
+		bool read(cv::Mat& frame);
+		void close();
+
+	private:
+		int fd;
+		std::unique_ptr<BlockingQueue<cv::Mat>> frames;
+		std::thread reader;
+};
+
+/**
+ * @brief 在单独的线程里把帧 / 记录写到 fd
+ */
+class PipeWriter{
+	public:
+		PipeWriter():fd(-1){}
+		~PipeWriter(){ close(); }
+
+		bool open(int fd, size_t queueCapacity);
+		bool isOpened() const { return fd >= 0; }
+		/**
+		 * @brief 写一帧 (CV_8UC3, 之后不能再修改)
+		 */
+		void writeFrame(const cv::Mat& frame);
+		/**
+		 * @brief 写一帧的关键点
+		 */
+		void writeKeypoints(int64_t frameIndex, int nParts, int nPeople, const std::vector<PoseKeypointRecord>& records);
+		/**
+		 * @brief 写完队列里剩下的, 结束线程
+		 */
+		void close();
+
+	private:
+		int fd;
+		std::unique_ptr<BlockingQueue<cv::Mat>> chunks;
+		std::thread writer;
+};
+
+#endif
@@ -0,0 +1,308 @@
+#include "pose-server.hpp"
+#include "pose-wire.hpp"
+#include "dynamic-batcher.hpp"
+#include "multi-person-openpose.hpp"
+#include "thread-budget.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<opencv2/imgcodecs.hpp>
+
+#include<atomic>
+#include<chrono>
+#include<cstring>
+#include<fstream>
+#include<iterator>
+#include<list>
+#include<thread>
+#include<vector>
+
+#include<errno.h>
+#include<poll.h>
+#include<signal.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<unistd.h>
+
+static bool socketAddress(const std::string& path, sockaddr_un& addr){
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(addr.sun_path)){
+		LOG_F(ERROR, "Socket path '%s' is too long", path.c_str());
+		return false;
+	}
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	return true;
+}
+
+static void serveClient(int fd, DynamicBatcher& batcher, const Settings& s){
+	static Counter& requests = metricsCounter("openpose_server_requests_total", "", "Requests answered");
+	static Counter& badRequests = metricsCounter("openpose_server_bad_requests_total", "", "Requests rejected");
+	static Gauge& clients = metricsGauge("openpose_server_clients", "", "Connected clients");
+	static Histogram& requestLatency = stageHistogram("request");
+	pinThread(STAGE_POSTPROCESS);
+	clients.add(1);
+
+	std::vector<uchar> payload;
+	std::vector<PoseKeypointRecord> records;
+	while(true){
+		PoseRequestHeader request;
+		if(!readFull(fd, &request, sizeof(request))){
+			break;
+		}
+		PoseResponseHeader response;
+		std::memset(&response, 0, sizeof(response));
+		response.magic = POSE_RESPONSE_MAGIC;
+		response.nParts = s.nPoints;
+
+		bool valid = request.magic == POSE_REQUEST_MAGIC && request.payloadBytes <= POSE_MAX_PAYLOAD
+			&& (request.format == FORMAT_ENCODED
+				|| (request.format == FORMAT_BGR && request.width > 0 && request.height > 0
+					&& request.payloadBytes == (uint64_t)request.width * request.height * 3));
+		if(!valid){
+			LOG_F(WARNING, "Server: bad request header, closing the connection");
+			badRequests.add();
+			response.status = -1;
+			writeFull(fd, &response, sizeof(response));
+			break;
+		}
+		payload.resize(request.payloadBytes);
+		if(!readFull(fd, payload.data(), payload.size())){
+			break;
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		StageLatency latency(requestLatency);
+		cv::Mat frame;
+		if(request.format == FORMAT_ENCODED){
+			TRACE_SCOPE("imdecode");
+			frame = cv::imdecode(payload, cv::IMREAD_COLOR);
+		}else{
+			/* Wraps the receive buffer, no copy */
+			frame = cv::Mat(request.height, request.width, CV_8UC3, payload.data());
+		}
+		if(frame.empty()){
+			LOG_F(WARNING, "Server: could not decode a %zu byte frame, closing the connection", payload.size());
+			badRequests.add();
+			response.status = -2;
+			writeFull(fd, &response, sizeof(response));
+			break;
+		}
+
+		PoseResult result;
+		cv::Mat netOutputBlob = batcher.infer(frame, s);
+		if(!netOutputBlob.empty()){
+			postProcess(netOutputBlob, frame.size(), result);
+		}
+		completePose(frame, s, result);
+		flattenPose(result, s.nPoints, records);
+
+		std::chrono::duration<double, std::milli> dur = std::chrono::steady_clock::now() - begin;
+		response.status = netOutputBlob.empty() ? -3 : 0;
+		response.nPeople = result.personwiseKeypoints.size();
+		response.frameWidth = frame.cols;
+		response.frameHeight = frame.rows;
+		response.inferMs = dur.count();
+		if(!writeFull(fd, &response, sizeof(response)) || !writeFull(fd, records.data(), records.size() * sizeof(PoseKeypointRecord))){
+			break;
+		}
+		requests.add();
+		LOG_F(1, "Server: %dx%d frame | people: %u | %.3f ms", frame.cols, frame.rows, response.nPeople, response.inferMs);
+	}
+	/* fd is closed by runServer after the join, so a shutdown() there never hits a reused descriptor */
+	clients.add(-1);
+}
+
+/* SIGINT / SIGTERM: the handler only writes to a pipe, the accept loop polls it */
+static int stopPipe[2] = {-1, -1};
+
+static void requestStop(int){
+	char c = 1;
+	ssize_t n = write(stopPipe[1], &c, 1);
+	(void)n;
+}
+
+struct Connection{
+	int fd;
+	std::thread thread;
+	std::atomic<bool> done;
+};
+
+int runServer(const Settings& s){
+	sockaddr_un addr;
+	if(!socketAddress(s.socketPath, addr)){
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	/* A socket file left by a previous run would make bind fail */
+	unlink(s.socketPath.c_str());
+	if(fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0){
+		LOG_F(ERROR, "Server: could not listen on '%s': %s", s.socketPath.c_str(), std::strerror(errno));
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+
+	if(pipe(stopPipe) != 0){
+		LOG_F(ERROR, "Server: could not create the stop pipe: %s", std::strerror(errno));
+		close(fd);
+		unlink(s.socketPath.c_str());
+		return -1;
+	}
+	struct sigaction action = {};
+	action.sa_handler = requestStop;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	/* Hands run on a warm pool too, connection threads never load their own */
+	if(s.detectHands){
+		handNetPool(s, s.serverNets);
+	}
+
+	/* The pool: serverNets networks shared by every connection through the batcher */
+	DynamicBatcher batcher(s.maxBatch, s.batchWaitMs);
+	std::vector<std::thread> nets;
+	for(int n = 0; n < s.serverNets; ++n){
+		nets.emplace_back([&batcher, &s]{
+			pinThread(STAGE_INFERENCE);
+			cv::dnn::Net net = loadNet(s);
+			batcher.run(net);
+		});
+	}
+	LOG_F(INFO, "Server: listening on '%s' | nets: %d | batch: %d (%d ms)", s.socketPath.c_str(), s.serverNets, s.maxBatch, s.batchWaitMs);
+
+	/* list: a Connection never moves while its thread runs */
+	std::list<Connection> connections;
+	int status = 0;
+	while(true){
+		/* Finished connections are joined here, their threads do not pile up */
+		for(std::list<Connection>::iterator it = connections.begin(); it != connections.end();){
+			if(it->done.load()){
+				it->thread.join();
+				close(it->fd);
+				it = connections.erase(it);
+			}else{
+				++it;
+			}
+		}
+
+		pollfd fds[2] = {{fd, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+		if(poll(fds, 2, 1000) < 0){
+			if(errno == EINTR) continue;
+			LOG_F(ERROR, "Server: poll failed: %s", std::strerror(errno));
+			status = -1;
+			break;
+		}
+		if(fds[1].revents){
+			LOG_F(INFO, "Server: stop requested");
+			break;
+		}
+		if(!fds[0].revents) continue;
+		int client = accept(fd, nullptr, nullptr);
+		if(client < 0){
+			if(errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) continue;
+			LOG_F(ERROR, "Server: accept failed: %s", std::strerror(errno));
+			status = -1;
+			break;
+		}
+		connections.emplace_back();
+		Connection& c = connections.back();
+		c.fd = client;
+		c.done.store(false);
+		c.thread = std::thread([&c, &batcher, &s]{
+			serveClient(c.fd, batcher, s);
+			c.done.store(true);
+		});
+	}
+
+	/* No new connections, wake every connection thread blocked on its socket */
+	close(fd);
+	unlink(s.socketPath.c_str());
+	for(Connection& c : connections){
+		shutdown(c.fd, SHUT_RDWR);
+	}
+	for(Connection& c : connections){
+		c.thread.join();
+		close(c.fd);
+	}
+	/* Requests in flight were answered above, the networks drain and return */
+	batcher.close();
+	for(std::thread& net : nets){
+		net.join();
+	}
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	close(stopPipe[0]);
+	close(stopPipe[1]);
+	LOG_F(INFO, "Server: stopped");
+	return status;
+}
+
+int runClient(const Settings& s){
+	std::ifstream file(s.imageFile, std::ios::binary);
+	std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if(image.empty()){
+		LOG_F(ERROR, "Client: could not read '%s'", s.imageFile.c_str());
+		return -1;
+	}
+
+	sockaddr_un addr;
+	if(!socketAddress(s.socketPath, addr)){
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0){
+		LOG_F(ERROR, "Client: could not connect to '%s': %s", s.socketPath.c_str(), std::strerror(errno));
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+
+	PoseRequestHeader request;
+	std::memset(&request, 0, sizeof(request));
+	request.magic = POSE_REQUEST_MAGIC;
+	request.format = FORMAT_ENCODED;
+	request.payloadBytes = image.size();
+
+	double totalMs = 0;
+	std::vector<PoseKeypointRecord> records;
+	for(int i = 0; i < s.clientRequests; ++i){
+		auto begin = std::chrono::steady_clock::now();
+		PoseResponseHeader response;
+		if(!writeFull(fd, &request, sizeof(request)) || !writeFull(fd, image.data(), image.size())
+				|| !readFull(fd, &response, sizeof(response)) || response.magic != POSE_RESPONSE_MAGIC){
+			LOG_F(ERROR, "Client: connection lost at request %d", i);
+			close(fd);
+			return -1;
+		}
+		if(response.status != 0){
+			LOG_F(ERROR, "Client: request %d failed with status %d", i, response.status);
+			close(fd);
+			return -1;
+		}
+		records.resize((size_t)response.nPeople * response.nParts);
+		if(!readFull(fd, records.data(), records.size() * sizeof(PoseKeypointRecord))){
+			LOG_F(ERROR, "Client: connection lost at request %d", i);
+			close(fd);
+			return -1;
+		}
+		std::chrono::duration<double, std::milli> dur = std::chrono::steady_clock::now() - begin;
+		totalMs += dur.count();
+		LOG_F(INFO, "Client: request %d | %ux%u | people: %u | server %.3f ms | round trip %.3f ms",
+				i, response.frameWidth, response.frameHeight, response.nPeople, response.inferMs, dur.count());
+	}
+	close(fd);
+
+	/* Keypoints of the last answer */
+	for(size_t p = 0; p * s.nPoints < records.size(); ++p){
+		std::cout << "Person " << p << std::endl;
+		for(int i = 0; i < s.nPoints; ++i){
+			const PoseKeypointRecord& r = records[p * s.nPoints + i];
+			if(r.score <= 0) continue;
+			std::cout << "\t" << s.keypointsMapping[i] << ": (" << r.x << ", " << r.y << ") " << r.score << std::endl;
+		}
+	}
+	LOG_F(INFO, "Client: %d requests, round trip avg %.3f ms", s.clientRequests, totalMs / s.clientRequests);
+	return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef __POSE_SERVER__H__
+#define __POSE_SERVER__H__
+
+#include "../include/settings.hpp"
+
+#include<cstdint>
+
+/*
+ * Protocol over a Unix domain stream socket (little endian), any number of
+ * requests per connection, each answered in order:
+ * 	client -> PoseRequestHeader + payload
+ * 		FORMAT_ENCODED 	-> payload is an image file (jpg, png, ...), width / height ignored
+ * 		FORMAT_BGR 	-> payload is width x height x 3 bytes, BGR, no row padding
+ * 	server -> PoseResponseHeader + nPeople x nParts PoseKeypointRecord (pose-wire.hpp)
+ */
+enum PoseFrameFormat{
+	FORMAT_ENCODED=0,
+	FORMAT_BGR
+};
+
+struct PoseRequestHeader{
+	uint32_t magic; 	// 0x51524F50 'PORQ'
+	uint32_t format; 	// PoseFrameFormat
+	uint32_t width;
+	uint32_t height;
+	uint64_t payloadBytes;
+};
+
+struct PoseResponseHeader{
+	uint32_t magic; 	// 0x53524F50 'PORS'
+	int32_t status; 	// 0 = ok, < 0 = bad request (the connection is closed after it)
+	uint32_t nPeople;
+	uint32_t nParts;
+	uint32_t frameWidth;
+	uint32_t frameHeight;
+	float inferMs; 		// time spent in the server for this request
+	uint32_t reserved;
+};
+
+const uint32_t POSE_REQUEST_MAGIC = 0x51524F50;
+const uint32_t POSE_RESPONSE_MAGIC = 0x53524F50;
+const uint64_t POSE_MAX_PAYLOAD = 256ull << 20;
+
+/**
+ * @brief 常驻服务: 在 socketPath 上监听, 每个连接一个线程,
+ * 	serverNets 个网络组成推理池 (maxBatch > 1 时不同连接的帧合成 batch)
+ * @param s
+ * 	SIGINT / SIGTERM: 停止 accept, 关闭所有连接, 等所有线程结束后返回
+ * @return 0 正常退出, 否则出错
+ */
+int runServer(const Settings& s);
+
+/**
+ * @brief 测试用客户端: 把 imageFile 发送 clientRequests 次, 打印结果和延迟
+ * @param s
+ * @return 0 全部成功, 否则出错
+ */
+int runClient(const Settings& s);
+
+#endif
@@ -0,0 +1,48 @@
+#include "pose-wire.hpp"
+
+#include<errno.h>
+#include<sys/socket.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+void flattenPose(const PoseResult& result, int nParts, std::vector<PoseKeypointRecord>& records){
+	records.clear();
+	records.reserve(result.personwiseKeypoints.size() * nParts);
+	for(const std::vector<int>& person : result.personwiseKeypoints){
+		for(int i = 0; i < nParts;++i){
+			int id = i < person.size() ? person[i] : -1;
+			if(id == -1){
+				records.push_back(PoseKeypointRecord{-1.f, -1.f, 0.f});
+			}else{
+				records.push_back(PoseKeypointRecord{(float)result.candidates.x[id], (float)result.candidates.y[id], result.candidates.score[id]});
+			}
+		}
+	}
+}
+
+bool readFull(int fd, void* buffer, size_t n){
+	char* p = (char*)buffer;
+	while(n > 0){
+		ssize_t got = read(fd, p, n);
+		if(got < 0 && errno == EINTR) continue;
+		if(got <= 0) return false;
+		p += got;
+		n -= got;
+	}
+	return true;
+}
+
+bool writeFull(int fd, const void* buffer, size_t n){
+	/* Sockets: no SIGPIPE when the peer is gone, the error is returned instead */
+	struct stat st;
+	bool socket = fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode);
+	const char* p = (const char*)buffer;
+	while(n > 0){
+		ssize_t put = socket ? send(fd, p, n, MSG_NOSIGNAL) : write(fd, p, n);
+		if(put < 0 && errno == EINTR) continue;
+		if(put <= 0) return false;
+		p += put;
+		n -= put;
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+#ifndef __POSE_WIRE__H__
+#define __POSE_WIRE__H__
+
+#include "multi-person-openpose.hpp"
+
+#include<cstdint>
+#include<vector>
+
+/*
+ * Pose results outside of the process (little endian, native floats):
+ * 	nPeople x nParts PoseKeypointRecord, person major
+ * 	a missing part is {-1, -1, 0}
+ */
+struct PoseKeypointRecord{
+	float x;
+	float y;
+	float score;
+};
+
+/**
+ * @brief 把每个人的骨架展开成 nPeople x nParts 个 PoseKeypointRecord
+ * @param result
+ * @param nParts 	-> Settings::nPoints
+ * @param records 	-> 返回值
+ */
+void flattenPose(const PoseResult& result, int nParts, std::vector<PoseKeypointRecord>& records);
+
+/**
+ * @brief 读 / 写满 n 个字节 (socket, pipe), 被信号打断时重试
+ * @return 是否成功 (false -> EOF 或出错)
+ */
+bool readFull(int fd, void* buffer, size_t n);
+bool writeFull(int fd, const void* buffer, size_t n);
+
+#endif
@@ -0,0 +1,235 @@
+#include "reference-openpose.hpp"
+
+/*
+ * Kept as it was before the post-processing fast paths.
+ * Do not optimize anything in this file, it is what the fast paths are compared against.
+ */
+
+static void getKeyPoints(cv::Mat& probMap,double threshold,std::vector<KeyPoint>& keyPoints){
+	cv::Mat smoothProbMap;
+	cv::GaussianBlur( probMap, smoothProbMap, cv::Size( 3, 3 ), 0, 0 );
+
+	cv::Mat maskedProbMap;
+	cv::threshold(smoothProbMap,maskedProbMap,threshold,255,cv::THRESH_BINARY);
+
+	maskedProbMap.convertTo(maskedProbMap,CV_8U,1);
+
+	std::vector<std::vector<cv::Point> > contours;
+	cv::findContours(maskedProbMap,contours,cv::RETR_TREE,cv::CHAIN_APPROX_SIMPLE);
+
+	for(int i = 0; i < contours.size();++i){
+		cv::Mat blobMask = cv::Mat::zeros(smoothProbMap.rows,smoothProbMap.cols,smoothProbMap.type());
+
+		cv::fillConvexPoly(blobMask,contours[i],cv::Scalar(1));
+
+		double maxVal;
+		cv::Point maxLoc;
+
+		cv::minMaxLoc(smoothProbMap.mul(blobMask),0,&maxVal,0,&maxLoc);
+
+		keyPoints.push_back(KeyPoint(maxLoc, probMap.at<float>(maxLoc.y,maxLoc.x)));
+	}
+}
+
+static void splitNetOutputBlobToParts(cv::Mat& netOutputBlob,const cv::Size& targetSize,std::vector<cv::Mat>& netOutputParts,int item){
+	int nParts = netOutputBlob.size[1];
+	int h = netOutputBlob.size[2];
+	int w = netOutputBlob.size[3];
+
+	for(int i = 0; i< nParts;++i){
+		cv::Mat part(h, w, CV_32F, netOutputBlob.ptr(item,i));
+
+		cv::Mat resizedPart;
+
+		cv::resize(part,resizedPart,targetSize);
+
+		netOutputParts.push_back(resizedPart);
+	}
+}
+
+static void populateInterpPoints(const cv::Point& a,const cv::Point& b,int numPoints,std::vector<cv::Point>& interpCoords){
+	float xStep = ((float)(b.x - a.x))/(float)(numPoints-1);
+	float yStep = ((float)(b.y - a.y))/(float)(numPoints-1);
+
+	interpCoords.push_back(a);
+
+	for(int i = 1; i< numPoints-1;++i){
+		interpCoords.push_back(cv::Point(a.x + xStep*i,a.y + yStep*i));
+	}
+
+	interpCoords.push_back(b);
+}
+
+static void getValidPairs(const Settings& s,
+		const std::vector<cv::Mat>& netOutputParts,
+		const std::vector<std::vector<KeyPoint>>& detectedKeypoints,
+		std::vector<std::vector<ValidPair>>& validPairs,
+		std::set<int>& invalidPairs) {
+
+	int nInterpSamples = 10;
+	float pafScoreTh = 0.1;
+	float confTh = 0.7;
+
+	for(int k = 0; k < s.mapIdx.size();++k ){
+
+		//A->B constitute a limb
+		cv::Mat pafA = netOutputParts[s.mapIdx[k].first];
+		cv::Mat pafB = netOutputParts[s.mapIdx[k].second];
+
+		//Find the keypoints for the first and second limb
+		const std::vector<KeyPoint>& candA = detectedKeypoints[s.posePairs[k].first];
+		const std::vector<KeyPoint>& candB = detectedKeypoints[s.posePairs[k].second];
+
+		int nA = candA.size();
+		int nB = candB.size();
+
+		if(nA != 0 && nB != 0){
+			std::vector<ValidPair> localValidPairs;
+
+			for(int i = 0; i< nA;++i){
+				int maxJ = -1;
+				float maxScore = -1;
+				bool found = false;
+
+				for(int j = 0; j < nB;++j){
+					std::pair<float,float> distance(candB[j].point.x - candA[i].point.x,candB[j].point.y - candA[i].point.y);
+
+					float norm = std::sqrt(distance.first*distance.first + distance.second*distance.second);
+
+					if(!norm){
+						continue;
+					}
+
+					distance.first /= norm;
+					distance.second /= norm;
+
+					//Find p(u)
+					std::vector<cv::Point> interpCoords;
+					populateInterpPoints(candA[i].point,candB[j].point,nInterpSamples,interpCoords);
+					//Find L(p(u))
+					std::vector<std::pair<float,float>> pafInterp;
+					for(int l = 0; l < interpCoords.size();++l){
+						pafInterp.push_back(
+								std::pair<float,float>(
+									pafA.at<float>(interpCoords[l].y,interpCoords[l].x),
+									pafB.at<float>(interpCoords[l].y,interpCoords[l].x)
+									));
+					}
+
+					std::vector<float> pafScores;
+					float sumOfPafScores = 0;
+					int numOverTh = 0;
+					for(int l = 0; l< pafInterp.size();++l){
+						float score = pafInterp[l].first*distance.first + pafInterp[l].second*distance.second;
+						sumOfPafScores += score;
+						if(score > pafScoreTh){
+							++numOverTh;
+						}
+
+						pafScores.push_back(score);
+					}
+
+					float avgPafScore = sumOfPafScores/((float)pafInterp.size());
+
+					if(((float)numOverTh)/((float)nInterpSamples) > confTh){
+						if(avgPafScore > maxScore){
+							maxJ = j;
+							maxScore = avgPafScore;
+							found = true;
+						}
+					}
+
+				}/* j */
+
+				if(found){
+					localValidPairs.push_back(ValidPair(candA[i].id,candB[maxJ].id,maxScore));
+				}
+
+			}/* i */
+
+			validPairs.push_back(localValidPairs);
+
+		} else {
+			invalidPairs.insert(k);
+			validPairs.push_back(std::vector<ValidPair>());
+		}
+	}/* k */
+}
+
+static void getPersonwiseKeypoints(const Settings& s,
+		const std::vector<std::vector<ValidPair>>& validPairs,
+		const std::set<int>& invalidPairs,
+		std::vector<std::vector<int>>& personwiseKeypoints) {
+	for(int k = 0; k < s.mapIdx.size();++k){
+		if(invalidPairs.find(k) != invalidPairs.end()){
+			continue;
+		}
+
+		const std::vector<ValidPair>& localValidPairs(validPairs[k]);
+
+		int indexA(s.posePairs[k].first);
+		int indexB(s.posePairs[k].second);
+
+		for(int i = 0; i< localValidPairs.size();++i){
+			bool found = false;
+			int personIdx = -1;
+
+			for(int j = 0; !found && j < personwiseKeypoints.size();++j){
+				if(indexA < personwiseKeypoints[j].size() &&
+						personwiseKeypoints[j][indexA] == localValidPairs[i].aId){
+					personIdx = j;
+					found = true;
+				}
+			}/* j */
+
+			if(found){
+				personwiseKeypoints[personIdx].at(indexB) = localValidPairs[i].bId;
+			} else if(k< (s.nPoints-1)){
+				std::vector<int> lpkp(std::vector<int>(s.nPoints,-1));
+
+				lpkp.at(indexA) = localValidPairs[i].aId;
+				lpkp.at(indexB) = localValidPairs[i].bId;
+
+				personwiseKeypoints.push_back(lpkp);
+			}
+
+		}/* i */
+	}/* k */
+}
+
+void referencePostProcess(cv::Mat& netOutputBlob, const cv::Size& targetSize, const Settings& s, PoseResult& result, int item){
+	std::vector<cv::Mat> netOutputParts;
+	splitNetOutputBlobToParts(netOutputBlob,targetSize,netOutputParts,item);
+
+	int keyPointId = 0;
+	std::vector<std::vector<KeyPoint>> detectedKeypoints;
+	std::vector<KeyPoint> keyPointsList;
+
+	for(int i = 0; i < s.nPoints;++i){
+		std::vector<KeyPoint> keyPoints;
+
+		getKeyPoints(netOutputParts[i],0.1,keyPoints);
+
+		for(int i = 0; i< keyPoints.size();++i,++keyPointId){
+			keyPoints[i].id = keyPointId;
+		}
+
+		detectedKeypoints.push_back(keyPoints);
+		keyPointsList.insert(keyPointsList.end(),keyPoints.begin(),keyPoints.end());
+	}
+
+	std::vector<std::vector<ValidPair>> validPairs;
+	std::set<int> invalidPairs;
+	getValidPairs(s,netOutputParts,detectedKeypoints,validPairs,invalidPairs);
+
+	getPersonwiseKeypoints(s,validPairs,invalidPairs,result.personwiseKeypoints);
+
+	/* Same layout as postProcess so both can be compared */
+	result.candidates.reset(0);
+	for(int i = 0; i < s.nPoints;++i){
+		result.candidates.beginPart();
+		for(const KeyPoint& kp : detectedKeypoints[i]){
+			result.candidates.push(kp.point, kp.probability);
+		}
+	}
+}
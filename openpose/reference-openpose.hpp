@@ -0,0 +1,18 @@
+#ifndef __REFERENCE_OPENPOSE__H__
+#define __REFERENCE_OPENPOSE__H__
+
+#include "multi-person-openpose.hpp"
+
+/**
+ * @brief 原始 (未优化) 的后处理, 用来验证 postProcess 的各种加速:
+ * 	所有通道都 resize, 每个 part 都做 blur + findContours, 所有 PAF 都参与配对
+ * 	拓扑 (nPoints, mapIdx, posePairs) 取自 s, 不依赖 initNet
+ * @param netOutputBlob 	-> Network Output
+ * @param targetSize 		-> 输入图片的大小
+ * @param s
+ * @param result 		-> 返回值
+ * @param item 			-> batch 中的第几张图
+ */
+void referencePostProcess(cv::Mat& netOutputBlob, const cv::Size& targetSize, const Settings& s, PoseResult& result, int item = 0);
+
+#endif
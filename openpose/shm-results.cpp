@@ -0,0 +1,287 @@
+#include "shm-results.hpp"
+#include "metrics.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+#include<cstring>
+
+#include<errno.h>
+#include<fcntl.h>
+#include<signal.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<time.h>
+#include<unistd.h>
+
+static size_t roundUp(size_t n, size_t alignment){
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+static int64_t monotonicNs(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool processAlive(uint32_t pid){
+	return pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+static uint64_t newGeneration(){
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t g = ((uint64_t)getpid() << 32) ^ ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+	return g != 0 ? g : 1;
+}
+
+static size_t headerBytes(int maxReaders){
+	/* readers[] is the last member and already holds one cursor */
+	return roundUp(sizeof(ShmResultHeader) + sizeof(ShmReaderCursor) * (std::max(1, maxReaders) - 1), 64);
+}
+
+static ShmResultSlot* slotAt(uint8_t* base, const ShmResultHeader* header, uint64_t seq){
+	return (ShmResultSlot*)(base + header->slotOffset + (seq % header->slotCount) * header->slotBytes);
+}
+
+static PoseKeypointRecord* slotRecords(ShmResultSlot* slot){
+	return (PoseKeypointRecord*)((uint8_t*)slot + sizeof(ShmResultSlot));
+}
+
+static uint8_t* slotFrame(ShmResultSlot* slot, const ShmResultHeader* header){
+	return (uint8_t*)slot + sizeof(ShmResultSlot) + roundUp(sizeof(PoseKeypointRecord) * header->maxPeople * header->nParts, 64);
+}
+
+bool ShmResultWriter::open(const std::string& name, int slots, int nParts, int maxPeople, int maxReaders, const cv::Size& frameSize){
+	close();
+	this->name = name;
+
+	/* A ring left by an earlier run may have another geometry: tell its readers to reopen, then replace it */
+	int old = shm_open(name.c_str(), O_RDWR, 0);
+	if(old >= 0){
+		struct stat st = {};
+		if(fstat(old, &st) == 0 && (size_t)st.st_size >= sizeof(ShmResultHeader)){
+			void* mapped = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, old, 0);
+			if(mapped != MAP_FAILED){
+				ShmResultHeader* oldHeader = (ShmResultHeader*)mapped;
+				if(oldHeader->magic.load(std::memory_order_acquire) == SHM_RESULT_MAGIC && oldHeader->version == SHM_RESULT_VERSION){
+					oldHeader->generation.store(0, std::memory_order_release);
+				}
+				munmap(mapped, st.st_size);
+			}
+		}
+		::close(old);
+	}
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+	if(fd < 0){
+		LOG_F(ERROR, "Shm Results: could not create '%s': %s", name.c_str(), std::strerror(errno));
+		return false;
+	}
+
+	size_t step = roundUp((size_t)frameSize.width * 3, 64);
+	size_t slotOffset = headerBytes(maxReaders);
+	size_t slotBytes = roundUp(sizeof(ShmResultSlot) + roundUp(sizeof(PoseKeypointRecord) * maxPeople * nParts, 64) + step * frameSize.height, 64);
+	length = slotOffset + slotBytes * slots;
+	if(ftruncate(fd, length) != 0){
+		LOG_F(ERROR, "Shm Results: could not size '%s' to %zu bytes: %s", name.c_str(), length, std::strerror(errno));
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	base = (uint8_t*)mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(base == MAP_FAILED){
+		LOG_F(ERROR, "Shm Results: could not map '%s': %s", name.c_str(), std::strerror(errno));
+		base = nullptr;
+		return false;
+	}
+
+	header = (ShmResultHeader*)base;
+	header->version = SHM_RESULT_VERSION;
+	header->slotCount = slots;
+	header->nParts = nParts;
+	header->maxPeople = maxPeople;
+	header->frameWidth = frameSize.width;
+	header->frameHeight = frameSize.height;
+	header->frameStep = step;
+	header->frameType = CV_8UC3;
+	header->slotOffset = slotOffset;
+	header->slotBytes = slotBytes;
+	header->maxReaders = maxReaders;
+	generation = newGeneration();
+	header->ownerPid.store(getpid());
+	header->generation.store(generation);
+	header->closed.store(0);
+	header->writeSeq.store(0);
+	header->magic.store(SHM_RESULT_MAGIC, std::memory_order_release);
+	LOG_F(INFO, "Shm Results: '%s' | %d slots of %zu bytes | frames: %dx%d | readers: %d", name.c_str(), slots, slotBytes,
+			frameSize.width, frameSize.height, maxReaders);
+	return true;
+}
+
+void ShmResultWriter::close(){
+	if(base){
+		/* Attached readers finish the ring, the name (and the memory, once they unmap) goes away */
+		header->closed.store(1, std::memory_order_release);
+		if(header->generation.load(std::memory_order_acquire) == generation){
+			shm_unlink(name.c_str());
+		}
+		munmap(base, length);
+	}
+	base = nullptr;
+	header = nullptr;
+	length = 0;
+	generation = 0;
+}
+
+void ShmResultWriter::publish(int64_t frameIndex, const std::vector<PoseKeypointRecord>& records, int nPeople, const cv::Mat& frame){
+	static Counter& published = metricsCounter("openpose_shm_results_total", "", "Results published to shared memory");
+	uint64_t n = header->writeSeq.load(std::memory_order_relaxed);
+	ShmResultSlot* slot = slotAt(base, header, n);
+
+	/* Odd: readers that see it (or see it change) discard their copy */
+	slot->seq.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	nPeople = std::min(nPeople, (int)header->maxPeople);
+	slot->frameIndex = frameIndex;
+	slot->timestampNs = monotonicNs();
+	slot->nPeople = nPeople;
+	std::memcpy(slotRecords(slot), records.data(), sizeof(PoseKeypointRecord) * nPeople * header->nParts);
+	slot->frameBytes = 0;
+	if(!frame.empty() && header->frameWidth == frame.cols && header->frameHeight == frame.rows && frame.type() == CV_8UC3){
+		cv::Mat placed(header->frameHeight, header->frameWidth, CV_8UC3, slotFrame(slot, header), header->frameStep);
+		frame.copyTo(placed);
+		slot->frameBytes = header->frameStep * header->frameHeight;
+	}
+
+	slot->seq.store(2 * n + 2, std::memory_order_release);
+	header->writeSeq.store(n + 1, std::memory_order_release);
+	published.add();
+
+	/* How far behind every attached reader is */
+	for(uint32_t r = 0; r < header->maxReaders;++r){
+		ShmReaderCursor& c = header->readers[r];
+		if(c.pid.load(std::memory_order_relaxed) == 0) continue;
+		static std::vector<Gauge*> lag;
+		if(lag.size() <= r) lag.resize(r + 1, nullptr);
+		if(!lag[r]) lag[r] = &metricsGauge("openpose_shm_reader_lag", cv::format("reader=\"%u\"", r), "Frames published but not yet read");
+		lag[r]->set((double)(n + 1) - (double)c.next.load(std::memory_order_relaxed));
+	}
+}
+
+bool ShmResultReader::open(const std::string& name){
+	close();
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0){
+		LOG_F(ERROR, "Shm Results: could not open '%s': %s", name.c_str(), std::strerror(errno));
+		return false;
+	}
+	struct stat st = {};
+	fstat(fd, &st);
+	length = st.st_size;
+	base = length >= sizeof(ShmResultHeader) ? (uint8_t*)mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : (uint8_t*)MAP_FAILED;
+	::close(fd);
+	if(base == MAP_FAILED){
+		LOG_F(ERROR, "Shm Results: could not map '%s'", name.c_str());
+		base = nullptr;
+		return false;
+	}
+	header = (ShmResultHeader*)base;
+	if(header->magic.load(std::memory_order_acquire) != SHM_RESULT_MAGIC || header->version != SHM_RESULT_VERSION
+			|| header->slotOffset + header->slotBytes * header->slotCount > length){
+		LOG_F(ERROR, "Shm Results: '%s' is not a version %u result ring", name.c_str(), SHM_RESULT_VERSION);
+		close();
+		return false;
+	}
+	generation = header->generation.load(std::memory_order_acquire);
+	if(generation == 0 || !processAlive(header->ownerPid.load())){
+		LOG_F(ERROR, "Shm Results: the writer of '%s' is gone", name.c_str());
+		close();
+		return false;
+	}
+
+	/* A free cursor, or one whose process is gone */
+	uint32_t self = getpid();
+	for(uint32_t r = 0; r < header->maxReaders && !cursor;++r){
+		ShmReaderCursor& c = header->readers[r];
+		uint32_t owner = c.pid.load();
+		if(owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH)) continue;
+		if(c.pid.compare_exchange_strong(owner, self)){
+			c.next.store(header->writeSeq.load(std::memory_order_acquire), std::memory_order_relaxed);
+			cursor = &c;
+		}
+	}
+	if(!cursor){
+		LOG_F(ERROR, "Shm Results: all %u reader cursors of '%s' are taken", header->maxReaders, name.c_str());
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ShmResultReader::close(){
+	if(cursor){
+		cursor->pid.store(0);
+	}
+	if(base){
+		munmap(base, length);
+	}
+	base = nullptr;
+	header = nullptr;
+	cursor = nullptr;
+	length = 0;
+	generation = 0;
+}
+
+ShmResultStatus ShmResultReader::read(ShmPoseFrame& out){
+	if(header->generation.load(std::memory_order_acquire) != generation){
+		return SHM_RESULT_REPLACED;
+	}
+	while(true){
+		uint64_t n = cursor->next.load(std::memory_order_relaxed);
+		uint64_t written = header->writeSeq.load(std::memory_order_acquire);
+		if(n >= written){
+			/* closed is set after the last publish, look once more */
+			if(header->closed.load(std::memory_order_acquire)){
+				if(header->writeSeq.load(std::memory_order_acquire) <= n) return SHM_RESULT_CLOSED;
+				continue;
+			}
+			/* A writer that was killed never sets closed */
+			if(!processAlive(header->ownerPid.load(std::memory_order_relaxed))){
+				return SHM_RESULT_REPLACED;
+			}
+			return SHM_RESULT_EMPTY;
+		}
+		if(written - n > header->slotCount){
+			/* Overwritten already, continue with the oldest frame still in the ring */
+			lapped += written - header->slotCount - n;
+			n = written - header->slotCount;
+		}
+
+		ShmResultSlot* slot = slotAt(base, header, n);
+		uint64_t s1 = slot->seq.load(std::memory_order_acquire);
+		if(s1 == 2 * n + 2){
+			out.frameIndex = slot->frameIndex;
+			out.timestampNs = slot->timestampNs;
+			out.nPeople = std::min(slot->nPeople, header->maxPeople);
+			out.records.resize((size_t)out.nPeople * header->nParts);
+			std::memcpy(out.records.data(), slotRecords(slot), sizeof(PoseKeypointRecord) * out.records.size());
+			uint32_t frameBytes = slot->frameBytes;
+			if(frameBytes > 0 && frameBytes == header->frameStep * header->frameHeight){
+				cv::Mat(header->frameHeight, header->frameWidth, header->frameType, slotFrame(slot, header), header->frameStep).copyTo(out.frame);
+			}else{
+				out.frame.release();
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t s2 = slot->seq.load(std::memory_order_relaxed);
+			if(s2 == s1){
+				cursor->next.store(n + 1, std::memory_order_release);
+				return SHM_RESULT_FRAME;
+			}
+		}
+		/* Being rewritten for a newer frame: this one is lost */
+		++lapped;
+		cursor->next.store(n + 1, std::memory_order_release);
+	}
+}
@@ -0,0 +1,155 @@
+#ifndef __SHM_RESULTS__H__
+#define __SHM_RESULTS__H__
+
+#include "pose-wire.hpp"
+
+#include<opencv2/core.hpp>
+
+#include<atomic>
+#include<cstdint>
+#include<string>
+#include<vector>
+
+/*
+ * POSIX shared memory result ring, one writer and any number of readers:
+ * 	ShmResultHeader (+ maxReaders ShmReaderCursor) 		-> offset 0
+ * 	slot i: ShmResultSlot + maxPeople x nParts PoseKeypointRecord
+ * 		+ rendered frame (step * frameHeight, if frameBytes > 0) 	-> offset slotOffset + i * slotBytes
+ * The writer never waits for readers, the oldest slot is overwritten.
+ * Every slot is a seqlock:
+ * 	writer 	-> seq = 2n+1, write, seq = 2n+2 (release), then writeSeq = n+1 (release)
+ * 	reader 	-> s1 = seq (acquire), copy, fence, s2 = seq; the copy of frame n is valid
+ * 		   when s1 == s2 == 2n+2, otherwise the slot was overwritten (lapped)
+ * Readers claim a ShmReaderCursor (pid != 0) and store the next sequence they will
+ * read in it, so the writer can export how far behind each reader is.
+ * The writer records its pid and a generation; on close it sets closed and unlinks the
+ * segment, a new writer sets generation 0 in the segment it replaces. Readers see
+ * closed (after the last frame), generation 0 or a dead ownerPid and reopen.
+ */
+struct ShmReaderCursor{
+	std::atomic<uint32_t> pid; 	// 0 = free
+	uint32_t reserved;
+	std::atomic<uint64_t> next;
+	char pad[48];
+};
+
+struct ShmResultHeader{
+	std::atomic<uint64_t> magic; 	// 0x53544C5345524F50 'POSERLTS'
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t nParts;
+	uint32_t maxPeople;
+	uint32_t frameWidth; 	// 0 when frames are not published
+	uint32_t frameHeight;
+	uint32_t frameStep;
+	int32_t frameType; 	// CV_8UC3
+	uint64_t slotOffset;
+	uint64_t slotBytes; 	// multiple of 64
+	uint32_t maxReaders;
+	std::atomic<uint32_t> ownerPid; 	// the writer
+	std::atomic<uint64_t> generation; 	// set by the writer, 0 = replaced
+	std::atomic<uint32_t> closed; 	// the writer closed the ring, no more frames
+	alignas(64) std::atomic<uint64_t> writeSeq;
+	alignas(64) ShmReaderCursor readers[1]; 	// maxReaders of them
+};
+
+struct alignas(64) ShmResultSlot{
+	std::atomic<uint64_t> seq;
+	int64_t frameIndex;
+	int64_t timestampNs; 	// CLOCK_MONOTONIC
+	uint32_t nPeople; 	// records: nPeople x nParts (at most maxPeople people)
+	uint32_t frameBytes; 	// 0 = no frame in this slot
+};
+
+const uint64_t SHM_RESULT_MAGIC = 0x53544C5345524F50ull;
+const uint32_t SHM_RESULT_VERSION = 2;
+
+enum ShmResultStatus{
+	SHM_RESULT_FRAME=0, 	// out holds the next frame
+	SHM_RESULT_EMPTY, 	// no new frame yet
+	SHM_RESULT_CLOSED, 	// the writer closed the ring and every frame was read
+	SHM_RESULT_REPLACED 	// the writer is gone or recreated the ring: open() again
+};
+
+/**
+ * @brief 一帧的结果 (reader 拷贝出来的)
+ */
+struct ShmPoseFrame{
+	int64_t frameIndex;
+	int64_t timestampNs;
+	int nPeople;
+	std::vector<PoseKeypointRecord> records;
+	cv::Mat frame; 	// empty when not published
+};
+
+/**
+ * @brief 写端: 每帧把结果 (和画好的图) 发布到共享内存, 从不等待读端
+ */
+class ShmResultWriter{
+	public:
+		ShmResultWriter():header(nullptr),base(nullptr),length(0),generation(0){}
+		~ShmResultWriter(){ close(); }
+		ShmResultWriter(const ShmResultWriter&) = delete;
+		ShmResultWriter& operator=(const ShmResultWriter&) = delete;
+
+		/**
+		 * @brief 创建 (已存在时重建) 共享内存 name
+		 * @param frameSize 	-> 发布的图的大小, 空 = 不发布图
+		 */
+		bool open(const std::string& name, int slots, int nParts, int maxPeople, int maxReaders, const cv::Size& frameSize);
+		/**
+		 * @brief 标记 closed 并删除共享内存 (已经打开的读端读完剩余的帧)
+		 */
+		void close();
+		bool isOpened() const { return header != nullptr; }
+
+		/**
+		 * @brief 发布一帧; 超过 maxPeople 的人被截掉
+		 * @param frame 	-> 画好的图 (CV_8UC3, frameSize), 可以为空
+		 */
+		void publish(int64_t frameIndex, const std::vector<PoseKeypointRecord>& records, int nPeople, const cv::Mat& frame);
+
+	private:
+		std::string name;
+		ShmResultHeader* header;
+		uint8_t* base;
+		size_t length;
+		uint64_t generation;
+};
+
+/**
+ * @brief 读端: 占用一个 cursor, 按顺序读出每一帧, 跟不上时跳到最旧的可用帧
+ */
+class ShmResultReader{
+	public:
+		ShmResultReader():header(nullptr),base(nullptr),length(0),cursor(nullptr),lapped(0),generation(0){}
+		~ShmResultReader(){ close(); }
+		ShmResultReader(const ShmResultReader&) = delete;
+		ShmResultReader& operator=(const ShmResultReader&) = delete;
+
+		/**
+		 * @brief 打开 name 并占用一个 cursor, 从最新的帧开始读
+		 */
+		bool open(const std::string& name);
+		void close();
+
+		/**
+		 * @brief 读下一帧, 从不等待
+		 * @return SHM_RESULT_FRAME 	-> out 是下一帧
+		 * 	SHM_RESULT_EMPTY 	-> 还没有新帧
+		 * 	SHM_RESULT_CLOSED / SHM_RESULT_REPLACED -> 写端已结束, 要跟随下一次运行需重新 open
+		 */
+		ShmResultStatus read(ShmPoseFrame& out);
+
+		uint64_t lappedFrames() const { return lapped; }
+
+	private:
+		ShmResultHeader* header;
+		uint8_t* base;
+		size_t length;
+		ShmReaderCursor* cursor;
+		uint64_t lapped; 	// frames overwritten before this reader got to them
+		uint64_t generation; 	// of the mapped segment
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "shm-ring.hpp"
+#include "metrics.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<chrono>
+#include<cstring>
+#include<thread>
+
+#include<errno.h>
+#include<fcntl.h>
+#include<signal.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<time.h>
+#include<unistd.h>
+
+static size_t roundUp(size_t n, size_t alignment){
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+/* Empty / full ring: spin a little, then sleep, the other side is usually one frame away */
+static void backoff(int& spins){
+	if(++spins < 64){
+		std::this_thread::yield();
+	}else{
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+}
+
+enum ShmAttach{
+	SHM_ATTACHED,
+	SHM_STALE, 	// creator died (or never finished the header), replace it
+	SHM_INVALID 	// live segment of another layout, leave it alone
+};
+
+static bool processAlive(uint32_t pid){
+	return pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+static uint64_t newGeneration(){
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t g = ((uint64_t)getpid() << 32) ^ ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+	return g != 0 ? g : 1;
+}
+
+bool ShmFrameRing::open(const std::string& name, int width, int height, int slots){
+	close();
+	this->name = name;
+	openWidth = width;
+	openHeight = height;
+	openSlots = slots;
+
+	/* Second round: the peer created the segment between our shm_open calls */
+	for(int attempt = 0; attempt < 2; ++attempt){
+		int fd = shm_open(name.c_str(), O_RDWR, 0660);
+		if(fd >= 0){
+			int result = attach(fd);
+			::close(fd);
+			if(result == SHM_ATTACHED){
+				LOG_F(INFO, "Shm: opened '%s' | %ux%u | %u slots", name.c_str(), header->width, header->height, header->slotCount);
+				return true;
+			}
+			if(result == SHM_INVALID){
+				return false;
+			}
+			/* Otherwise its closed / writeSeq / readSeq would end the next run at once */
+			LOG_F(WARNING, "Shm: '%s' was left by a finished process, replacing it", name.c_str());
+			shm_unlink(name.c_str());
+		}else if(errno != ENOENT){
+			LOG_F(ERROR, "Shm: could not open '%s': %s", name.c_str(), std::strerror(errno));
+			return false;
+		}
+
+		fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+		if(fd < 0 && errno == EEXIST){
+			continue;
+		}
+		if(fd < 0){
+			LOG_F(ERROR, "Shm: could not create '%s': %s", name.c_str(), std::strerror(errno));
+			return false;
+		}
+		return create(fd, width, height, slots);
+	}
+	LOG_F(ERROR, "Shm: could not open '%s', it keeps being replaced", name.c_str());
+	return false;
+}
+
+int ShmFrameRing::attach(int fd){
+	/* The creator may still be sizing and filling the header */
+	struct stat st = {};
+	for(int i = 0; i < 5000 && (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ShmRingHeader)); ++i){
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if(st.st_size < (off_t)sizeof(ShmRingHeader)){
+		return SHM_STALE;
+	}
+	length = st.st_size;
+	base = (uint8_t*)mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(base == MAP_FAILED){
+		LOG_F(ERROR, "Shm: could not map '%s': %s", name.c_str(), std::strerror(errno));
+		base = nullptr;
+		length = 0;
+		return SHM_INVALID;
+	}
+	header = (ShmRingHeader*)base;
+	for(int i = 0; i < 5000 && header->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC; ++i){
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if(header->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC){
+		close();
+		return SHM_STALE;
+	}
+	if(header->version != SHM_RING_VERSION || header->type != CV_8UC3 || header->slotOffset + header->slotBytes * header->slotCount > length){
+		LOG_F(ERROR, "Shm: '%s' is not a version %u frame ring", name.c_str(), SHM_RING_VERSION);
+		close();
+		return SHM_INVALID;
+	}
+	if(header->generation.load(std::memory_order_acquire) == 0 || !processAlive(header->ownerPid.load(std::memory_order_relaxed))){
+		/* A peer still attached to it moves to the segment that replaces it */
+		header->generation.store(0, std::memory_order_release);
+		close();
+		return SHM_STALE;
+	}
+	generation = header->generation.load(std::memory_order_acquire);
+	created = false;
+	return SHM_ATTACHED;
+}
+
+bool ShmFrameRing::create(int fd, int width, int height, int slots){
+	size_t step = roundUp((size_t)width * 3, 64);
+	size_t slotOffset = roundUp(sizeof(ShmRingHeader), 64);
+	size_t slotBytes = roundUp(sizeof(ShmSlotHeader) + step * height, 64);
+	length = slotOffset + slotBytes * slots;
+	if(ftruncate(fd, length) != 0){
+		LOG_F(ERROR, "Shm: could not size '%s' to %zu bytes: %s", name.c_str(), length, std::strerror(errno));
+		::close(fd);
+		shm_unlink(name.c_str());
+		length = 0;
+		return false;
+	}
+	base = (uint8_t*)mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(base == MAP_FAILED){
+		LOG_F(ERROR, "Shm: could not map '%s': %s", name.c_str(), std::strerror(errno));
+		shm_unlink(name.c_str());
+		base = nullptr;
+		length = 0;
+		return false;
+	}
+
+	/* ftruncate zero fills: every slot seq is 0, nothing is readable yet */
+	generation = newGeneration();
+	created = true;
+	header = (ShmRingHeader*)base;
+	header->version = SHM_RING_VERSION;
+	header->slotCount = slots;
+	header->width = width;
+	header->height = height;
+	header->type = CV_8UC3;
+	header->step = step;
+	header->slotOffset = slotOffset;
+	header->slotBytes = slotBytes;
+	header->fps = 0;
+	header->ownerPid.store(getpid());
+	header->generation.store(generation);
+	header->closed.store(0);
+	header->writeSeq.store(0);
+	header->readSeq.store(0);
+	header->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+	LOG_F(INFO, "Shm: created '%s' | %ux%u | %u slots", name.c_str(), header->width, header->height, header->slotCount);
+	return true;
+}
+
+void ShmFrameRing::close(){
+	if(base){
+		release();
+		/* The creator removes the name, unless the segment was already replaced */
+		if(created && header->generation.load(std::memory_order_acquire) == generation){
+			header->generation.store(0, std::memory_order_release);
+			shm_unlink(name.c_str());
+		}
+		munmap(base, length);
+	}
+	base = nullptr;
+	header = nullptr;
+	length = 0;
+	holding = false;
+	generation = 0;
+	created = false;
+}
+
+bool ShmFrameRing::replaced() const{
+	return header->generation.load(std::memory_order_acquire) != generation;
+}
+
+bool ShmFrameRing::reattach(){
+	LOG_F(WARNING, "Shm: '%s' was replaced, attaching to the new ring", name.c_str());
+	/* The held slot belongs to the old segment */
+	holding = false;
+	std::string current = name;
+	return open(current, openWidth, openHeight, openSlots);
+}
+
+ShmSlotHeader* ShmFrameRing::slot(uint64_t seq) const{
+	return (ShmSlotHeader*)(base + header->slotOffset + (seq % header->slotCount) * header->slotBytes);
+}
+
+cv::Mat ShmFrameRing::slotMat(uint64_t seq) const{
+	return cv::Mat(header->height, header->width, header->type, (uint8_t*)slot(seq) + sizeof(ShmSlotHeader), header->step);
+}
+
+void ShmFrameRing::release(){
+	if(holding){
+		header->readSeq.fetch_add(1, std::memory_order_release);
+		holding = false;
+	}
+}
+
+bool ShmFrameRing::next(cv::Mat& frame, int64_t& frameIndex){
+	release();
+	while(true){
+		uint64_t seq = header->readSeq.load(std::memory_order_relaxed);
+		int spins = 0;
+		bool ready = true;
+		while(header->writeSeq.load(std::memory_order_acquire) <= seq){
+			if(header->closed.load(std::memory_order_acquire)){
+				/* closed is set after the last commit, look once more */
+				if(header->writeSeq.load(std::memory_order_acquire) <= seq) return false;
+				break;
+			}
+			if(replaced()){
+				if(!reattach()) return false;
+				ready = false;
+				break;
+			}
+			backoff(spins);
+		}
+		if(!ready) continue;
+
+		ShmSlotHeader* s = slot(seq);
+		uint64_t slotSeq = s->seq.load(std::memory_order_acquire);
+		if(slotSeq != seq + 1){
+			/* Not the frame that was committed: give the slot back and count it as dropped */
+			LOG_F(WARNING, "Shm: slot %llu holds sequence %llu, expected %llu, frame dropped", (unsigned long long)(seq % header->slotCount),
+					(unsigned long long)slotSeq - 1, (unsigned long long)seq);
+			metricsCounter("openpose_frames_dropped_total", metricsLabel("stream", name), "Frames dropped").add();
+			header->readSeq.fetch_add(1, std::memory_order_release);
+			continue;
+		}
+		frameIndex = s->frameIndex;
+		frame = slotMat(seq);
+		holding = true;
+		return true;
+	}
+}
+
+cv::Mat ShmFrameRing::beginWrite(){
+	int spins = 0;
+	while(header->writeSeq.load(std::memory_order_relaxed) - header->readSeq.load(std::memory_order_acquire) >= header->slotCount){
+		if(replaced() && !reattach()) return cv::Mat();
+		backoff(spins);
+	}
+	return slotMat(header->writeSeq.load(std::memory_order_relaxed));
+}
+
+void ShmFrameRing::commit(int64_t frameIndex){
+	uint64_t seq = header->writeSeq.load(std::memory_order_relaxed);
+	ShmSlotHeader* s = slot(seq);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->frameIndex = frameIndex;
+	s->timestampNs = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	s->seq.store(seq + 1, std::memory_order_release);
+	header->writeSeq.store(seq + 1, std::memory_order_release);
+}
+
+void ShmFrameRing::markClosed(){
+	header->closed.store(1, std::memory_order_release);
+}
@@ -0,0 +1,112 @@
+#ifndef __SHM_RING__H__
+#define __SHM_RING__H__
+
+#include<opencv2/core.hpp>
+
+#include<atomic>
+#include<cstdint>
+#include<string>
+
+/*
+ * POSIX shared memory frame ring, one producer and one consumer (SPSC):
+ * 	ShmRingHeader 					-> offset 0
+ * 	slot i: ShmSlotHeader + pixels (step * height) 	-> offset slotOffset + i * slotBytes
+ * Producer: wait until writeSeq - readSeq < slotCount, fill slot writeSeq % slotCount,
+ * 	set slot.seq = writeSeq + 1, then writeSeq + 1 (release).
+ * Consumer: wait until readSeq < writeSeq (acquire), use slot readSeq % slotCount
+ * 	in place, then readSeq + 1 (release) gives the slot back.
+ * 	A slot whose seq is not readSeq + 1 is counted as dropped and skipped.
+ * closed != 0 -> the producer is gone, the consumer stops once the ring is empty.
+ * Whoever comes first creates the segment (O_EXCL), fills the header and writes magic last;
+ * the creator unlinks it on close. A segment whose creator (ownerPid) is dead is stale:
+ * the next open sets its generation to 0 and replaces it, a peer still attached to it
+ * sees the generation change and attaches to the new segment.
+ */
+struct ShmRingHeader{
+	std::atomic<uint64_t> magic; 	// 0x474E49524D485350 'PSHMRING'
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t width;
+	uint32_t height;
+	int32_t type; 		// OpenCV type, CV_8UC3 (BGR)
+	uint32_t step; 		// bytes per row
+	uint64_t slotOffset;
+	uint64_t slotBytes; 	// multiple of 64
+	double fps; 		// 0 = unknown
+	std::atomic<uint32_t> ownerPid; 	// process that created the segment
+	std::atomic<uint64_t> generation; 	// set by the creator, 0 = replaced
+	std::atomic<uint32_t> closed;
+	alignas(64) std::atomic<uint64_t> writeSeq;
+	alignas(64) std::atomic<uint64_t> readSeq;
+};
+
+struct alignas(64) ShmSlotHeader{
+	std::atomic<uint64_t> seq; 	// sequence number + 1 of the frame in the slot
+	int64_t frameIndex;
+	int64_t timestampNs; 	// producer clock, CLOCK_MONOTONIC
+};
+
+const uint64_t SHM_RING_MAGIC = 0x474E49524D485350ull;
+const uint32_t SHM_RING_VERSION = 2;
+
+/**
+ * @brief 共享内存帧环 (SPSC), 消费者直接把 slot 包装成 cv::Mat, 不拷贝
+ */
+class ShmFrameRing{
+	public:
+		ShmFrameRing():header(nullptr),base(nullptr),length(0),holding(false),generation(0),created(false),openWidth(0),openHeight(0),openSlots(0){}
+		~ShmFrameRing(){ close(); }
+		ShmFrameRing(const ShmFrameRing&) = delete;
+		ShmFrameRing& operator=(const ShmFrameRing&) = delete;
+
+		/**
+		 * @brief 打开 (不存在或已失效时按 width x height x slots 创建) 共享内存 name, e.g. "/openpose-frames"
+		 * 	已存在时以其中的 header 为准
+		 */
+		bool open(const std::string& name, int width, int height, int slots);
+		void close();
+		bool isOpened() const { return header != nullptr; }
+
+		int width() const { return header->width; }
+		int height() const { return header->height; }
+		double fps() const { return header->fps; }
+
+		/**
+		 * @brief 消费者: 归还上一帧的 slot, 等待下一帧
+		 * @param frame 	-> 返回值, 指向共享内存, 下一次 next() 之前有效
+		 * @param frameIndex 	-> 返回值, 生产者给的编号
+		 * @return false 	-> 生产者已关闭并且没有剩余的帧 (或重新连接失败)
+		 */
+		bool next(cv::Mat& frame, int64_t& frameIndex);
+
+		/**
+		 * @brief 生产者: 等待一个空的 slot, 返回指向它的 cv::Mat (写好后 commit)
+		 * 	重新连接失败时为空
+		 */
+		cv::Mat beginWrite();
+		void commit(int64_t frameIndex);
+		/**
+		 * @brief 生产者: 不再有新帧
+		 */
+		void markClosed();
+
+	private:
+		ShmSlotHeader* slot(uint64_t seq) const;
+		cv::Mat slotMat(uint64_t seq) const;
+		void release();
+		int attach(int fd);
+		bool create(int fd, int width, int height, int slots);
+		bool replaced() const;
+		bool reattach();
+
+		std::string name;
+		ShmRingHeader* header;
+		uint8_t* base;
+		size_t length;
+		bool holding; 	// consumer holds slot readSeq
+		uint64_t generation; 	// of the mapped segment
+		bool created; 		// this process created it, unlinks it on close
+		int openWidth, openHeight, openSlots; 	// for reattach
+};
+
+#endif
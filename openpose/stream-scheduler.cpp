@@ -0,0 +1,269 @@
+#include "stream-scheduler.hpp"
+#include "multi-person-openpose.hpp"
+#include "dynamic-batcher.hpp"
+#include "thread-budget.hpp"
+#include "trace.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<opencv2/videoio.hpp>
+
+#include<algorithm>
+#include<atomic>
+#include<cctype>
+#include<thread>
+
+static std::string streamLabel(const StreamSettings& stream){
+	return metricsLabel("stream", stream.name);
+}
+
+bool isLiveSource(const std::string& source){
+	bool digits = !source.empty() && std::all_of(source.begin(), source.end(), [](unsigned char c){ return std::isdigit(c); });
+	return digits || source.find("://") != std::string::npos;
+}
+
+static cv::VideoCapture openSource(const std::string& source){
+	bool digits = !source.empty() && std::all_of(source.begin(), source.end(), [](unsigned char c){ return std::isdigit(c); });
+	return digits ? cv::VideoCapture(std::stoi(source)) : cv::VideoCapture(source);
+}
+
+StreamScheduler::StreamScheduler(const std::vector<StreamSettings>& streams, size_t queueCapacity):capacity(queueCapacity),closed(false),virtualTime(0),states(streams.size()){
+	for(size_t i = 0; i < streams.size();++i){
+		StreamState& st = states[i];
+		st.live = isLiveSource(streams[i].source);
+		st.cost = 1.0 / streams[i].priority;
+		st.interval = streams[i].fpsCap > 0
+			? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / streams[i].fpsCap))
+			: Clock::duration::zero();
+		st.vtime = 0;
+		st.nextAllowed = Clock::now();
+		st.busy = false;
+		st.finished = false;
+		st.dropped = &metricsCounter("openpose_frames_dropped_total", streamLabel(streams[i]), "Frames dropped");
+		st.depth = &metricsGauge("openpose_queue_depth", metricsLabel("queue", streams[i].name), "Frames waiting in a queue");
+	}
+}
+
+bool StreamScheduler::push(StreamFrame frame){
+	std::unique_lock<std::mutex> lock(mutex);
+	StreamState& st = states[frame.stream];
+	if(!st.live){
+		/* Files are read no faster than they are processed, nothing is dropped */
+		changed.wait(lock, [&]{ return closed || st.queue.size() < capacity; });
+	}
+	if(closed) return false;
+	if(st.queue.size() >= capacity){
+		/* Live sources keep the newest frames */
+		st.queue.pop_front();
+		st.dropped->add();
+	}
+	if(st.queue.empty() && !st.busy){
+		/* An idle stream starts at the current virtual time, it can not bank credit */
+		st.vtime = std::max(st.vtime, virtualTime);
+	}
+	st.queue.push_back(std::move(frame));
+	st.depth->set(st.queue.size());
+	changed.notify_all();
+	return true;
+}
+
+void StreamScheduler::finish(int stream){
+	std::lock_guard<std::mutex> lock(mutex);
+	states[stream].finished = true;
+	changed.notify_all();
+}
+
+bool StreamScheduler::next(StreamFrame& frame){
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		Clock::time_point now = Clock::now();
+		Clock::time_point wake = Clock::time_point::max();
+		int best = -1;
+		bool remaining = false;
+		for(int i = 0; i < states.size();++i){
+			const StreamState& st = states[i];
+			if(!st.finished || !st.queue.empty() || st.busy){
+				remaining = true;
+			}
+			if(st.queue.empty() || st.busy){
+				continue;
+			}
+			if(st.nextAllowed > now){
+				wake = std::min(wake, st.nextAllowed);
+				continue;
+			}
+			if(best == -1 || st.vtime < states[best].vtime){
+				best = i;
+			}
+		}
+		if(best != -1){
+			StreamState& st = states[best];
+			frame = std::move(st.queue.front());
+			st.queue.pop_front();
+			st.depth->set(st.queue.size());
+			st.busy = true;
+			virtualTime = st.vtime;
+			st.vtime += st.cost;
+			st.nextAllowed = now + st.interval;
+			changed.notify_all();
+			return true;
+		}
+		if(closed || !remaining){
+			return false;
+		}
+		if(wake == Clock::time_point::max()){
+			changed.wait(lock);
+		}else{
+			changed.wait_until(lock, wake);
+		}
+	}
+}
+
+void StreamScheduler::done(int stream){
+	std::lock_guard<std::mutex> lock(mutex);
+	states[stream].busy = false;
+	changed.notify_all();
+}
+
+void StreamScheduler::close(){
+	std::lock_guard<std::mutex> lock(mutex);
+	closed = true;
+	changed.notify_all();
+}
+
+size_t runStreams(const Settings& s){
+	int nStreams = s.streams.size();
+	int nNets = std::max(1, s.streamNets);
+	/*
+	 * Batching needs up to maxBatch frames in flight per network, so there are more workers than networks;
+	 * they post-process, so there are at least as many as the post-processing cores
+	 */
+	bool batched = s.maxBatch > 1;
+	int nWorkers = batched ? std::max(nNets * s.maxBatch, threadBudget().postprocess) : nNets;
+	LOG_F(INFO, "Multi: %d streams | nets: %d | workers: %d | queue: %d", nStreams, nNets, nWorkers, s.streamQueue);
+	if(batched){
+		LOG_F(INFO, "Multi: dynamic batching, up to %d frames, %d ms deadline", s.maxBatch, s.batchWaitMs);
+		if(s.twoPass || s.tileSize > 0){
+			LOG_F(WARNING, "twoPass and tileSize are ignored with maxBatch > 1");
+		}
+	}
+	DynamicBatcher batcher(s.maxBatch, s.batchWaitMs);
+
+	StreamScheduler scheduler(s.streams, std::max(1, s.streamQueue));
+	/* Opened by the capture thread before its first frame, then only used by the worker holding the stream */
+	std::vector<cv::VideoWriter> writers(nStreams);
+	std::vector<Counter*> framesIn, framesOut;
+	std::vector<Histogram*> frameLatency;
+	for(const StreamSettings& stream : s.streams){
+		framesIn.push_back(&metricsCounter("openpose_frames_in_total", streamLabel(stream), "Frames decoded"));
+		framesOut.push_back(&metricsCounter("openpose_frames_out_total", streamLabel(stream), "Frames written"));
+		frameLatency.push_back(&metricsHistogram("openpose_stream_frame_seconds", streamLabel(stream), "Latency of a frame of a stream", latencyBuckets()));
+	}
+	std::atomic<size_t> processed(0);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	std::vector<std::thread> netThreads;
+	if(batched){
+		for(int n = 0; n < nNets; ++n){
+			netThreads.emplace_back([&]{
+				pinThread(STAGE_INFERENCE);
+				cv::dnn::Net net = loadNet(s);
+				batcher.run(net);
+			});
+		}
+	}
+	for(int i = 0; i < nStreams; ++i){
+		threads.emplace_back([&, i]{
+			pinThread(STAGE_IO);
+			const StreamSettings& stream = s.streams[i];
+			cv::VideoCapture cap = openSource(stream.source);
+			if(!cap.isOpened()){
+				LOG_F(ERROR, "Stream '%s': could not open '%s'", stream.name.c_str(), stream.source.c_str());
+				scheduler.finish(i);
+				return;
+			}
+			if(!stream.output.empty()){
+				double fps = cap.get(cv::CAP_PROP_FPS);
+				if(fps <= 0) fps = 25;
+				/* Live sources drop frames above the cap, files are throttled and keep every frame */
+				if(stream.fpsCap > 0 && isLiveSource(stream.source)) fps = std::min(fps, stream.fpsCap);
+				cv::Size size(cap.get(cv::CAP_PROP_FRAME_WIDTH), cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+				writers[i].open(stream.output, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, size);
+				if(!writers[i].isOpened()){
+					LOG_F(WARNING, "Stream '%s': could not write '%s'", stream.name.c_str(), stream.output.c_str());
+				}
+			}
+			LOG_F(INFO, "Stream '%s': %s (%s) | priority %.2f | fps cap %.2f", stream.name.c_str(), stream.source.c_str(),
+					isLiveSource(stream.source) ? "live" : "file", stream.priority, stream.fpsCap);
+
+			int64_t index = 0;
+			while(true){
+				StreamFrame item{i, index++, cv::Mat()};
+				{
+					TRACE_SCOPE("capture");
+					/* A fresh Mat every frame, the queued ones must not be decoded into */
+					if(!cap.read(item.frame)) break;
+				}
+				framesIn[i]->add();
+				if(!scheduler.push(std::move(item))) break;
+			}
+			LOG_F(INFO, "Stream '%s': end of input after %lld frames", stream.name.c_str(), (long long)index - 1);
+			scheduler.finish(i);
+		});
+	}
+	for(int n = 0; n < nWorkers; ++n){
+		threads.emplace_back([&]{
+			pinThread(batched ? STAGE_POSTPROCESS : STAGE_INFERENCE);
+			cv::dnn::Net net;
+			if(!batched){
+				net = loadNet(s);
+			}
+			StreamFrame item;
+			while(scheduler.next(item)){
+				{
+					StageLatency latency(*frameLatency[item.stream]);
+					PoseResult result;
+					if(batched){
+						cv::Mat netOutputBlob = batcher.infer(item.frame, s);
+						if(!netOutputBlob.empty()){
+							postProcess(netOutputBlob, item.frame.size(), result);
+						}
+						completePose(item.frame, s, result);
+					}else{
+						detectPose(net, item.frame, s, result);
+					}
+					if(writers[item.stream].isOpened()){
+						/* The frame is owned by this item, draw on it directly */
+						renderPose(item.frame, result, !s.renderFast);
+						TRACE_SCOPE("write");
+						writers[item.stream].write(item.frame);
+					}
+					LOG_F(1, "Stream '%s' | Frame: %-6lld | people: %zu", s.streams[item.stream].name.c_str(), (long long)item.index, result.personwiseKeypoints.size());
+				}
+				framesOut[item.stream]->add();
+				++processed;
+				scheduler.done(item.stream);
+			}
+		});
+	}
+	for(std::thread& t : threads){
+		t.join();
+	}
+	batcher.close();
+	for(std::thread& t : netThreads){
+		t.join();
+	}
+	for(cv::VideoWriter& writer : writers){
+		writer.release();
+	}
+
+	std::chrono::duration<double> dur = std::chrono::steady_clock::now() - start;
+	for(int i = 0; i < nStreams; ++i){
+		LOG_F(INFO, "Stream '%s': %llu in | %llu processed | %llu dropped", s.streams[i].name.c_str(),
+				(unsigned long long)framesIn[i]->get(), (unsigned long long)framesOut[i]->get(),
+				(unsigned long long)metricsCounter("openpose_frames_dropped_total", streamLabel(s.streams[i]), "Frames dropped").get());
+	}
+	LOG_F(INFO, "Multi Finished: %zu frames in %.2f s (%.2f frames/s)", processed.load(), dur.count(), processed.load() / dur.count());
+	return processed.load();
+}
@@ -0,0 +1,92 @@
+#ifndef __STREAM_SCHEDULER__H__
+#define __STREAM_SCHEDULER__H__
+
+#include "../include/settings.hpp"
+#include "metrics.hpp"
+
+#include<chrono>
+#include<condition_variable>
+#include<deque>
+#include<mutex>
+#include<vector>
+
+struct StreamFrame{
+	int stream;
+	int64_t index;
+	cv::Mat frame;
+};
+
+/**
+ * @brief 多路输入共享推理能力的调度器
+ * 	每路输入一个小队列: 实时源 (摄像头 / URL) 满了丢最旧的帧, 文件满了阻塞读取
+ * 	next() 在有帧且没超过 fpsCap 的输入中选虚拟时间最小的一路 (加权公平排队),
+ * 	每推理一帧虚拟时间增加 1 / priority; 空闲后回来的输入不能积攒额度
+ * 	同一路输入同一时间只交给一个 worker, 所以每路的输出保持顺序
+ */
+class StreamScheduler{
+	public:
+		StreamScheduler(const std::vector<StreamSettings>& streams, size_t queueCapacity);
+
+		/**
+		 * @brief 读取线程放入一帧
+		 * @return false 	-> 调度器已关闭
+		 */
+		bool push(StreamFrame frame);
+
+		/**
+		 * @brief 这一路输入已经读完
+		 */
+		void finish(int stream);
+
+		/**
+		 * @brief worker 取下一帧, 阻塞直到有可推理的帧
+		 * @return false 	-> 所有输入都已读完并且处理完
+		 */
+		bool next(StreamFrame& frame);
+
+		/**
+		 * @brief worker 处理完了 stream 的一帧
+		 */
+		void done(int stream);
+
+		void close();
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+		struct StreamState{
+			std::deque<StreamFrame> queue;
+			bool live;
+			double cost; 		// virtual time of one frame, 1 / priority
+			Clock::duration interval; 	// 1 / fpsCap
+			double vtime;
+			Clock::time_point nextAllowed;
+			bool busy;
+			bool finished;
+			Counter* dropped;
+			Gauge* depth;
+		};
+
+		size_t capacity;
+		bool closed;
+		double virtualTime; 	// virtual time of the last frame handed out
+		std::vector<StreamState> states;
+		std::mutex mutex;
+		std::condition_variable changed;
+};
+
+/**
+ * @brief 是否是实时源 (摄像头编号或 URL), 实时源来不及处理时丢帧
+ * @param source
+ */
+bool isLiveSource(const std::string& source);
+
+/**
+ * @brief 多路输入: 每路一个读取线程, streamNets 个网络 (各一个线程) 按 StreamScheduler 轮流处理
+ * 	每路的结果写到各自的 output
+ * 	maxBatch > 1 时网络由 DynamicBatcher 驱动, 不同输入的帧合成一个 batch
+ * @param s
+ * @return 处理的帧数
+ */
+size_t runStreams(const Settings& s);
+
+#endif
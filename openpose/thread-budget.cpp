@@ -0,0 +1,126 @@
+#include "thread-budget.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<opencv2/core.hpp>
+
+#include<algorithm>
+#include<cmath>
+#include<fstream>
+#include<string>
+
+#include<pthread.h>
+#include<sched.h>
+
+static ThreadBudget budget = {1, 1, 1, 1, false, {}};
+
+/**
+ * @brief cgroup v2 (cpu.max) 或 v1 (cfs_quota_us / cfs_period_us) 的 quota, 没有限制返回 0
+ */
+static int cgroupCpuQuota(){
+	std::ifstream v2("/sys/fs/cgroup/cpu.max");
+	if(v2.is_open()){
+		std::string quota;
+		double period = 0;
+		v2 >> quota >> period;
+		if(quota == "max" || period <= 0) return 0;
+		return (int)std::ceil(std::stod(quota) / period);
+	}
+	std::ifstream quotaFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+	std::ifstream periodFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+	if(quotaFile.is_open() && periodFile.is_open()){
+		double quota = -1, period = 0;
+		quotaFile >> quota;
+		periodFile >> period;
+		if(quota <= 0 || period <= 0) return 0;
+		return (int)std::ceil(quota / period);
+	}
+	return 0;
+}
+
+static std::vector<int> affinityCpus(){
+	std::vector<int> cpus;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(sched_getaffinity(0, sizeof(set), &set) == 0){
+		for(int i = 0; i < CPU_SETSIZE; ++i){
+			if(CPU_ISSET(i, &set)) cpus.push_back(i);
+		}
+	}
+	if(cpus.empty()){
+		for(int i = 0; i < cv::getNumberOfCPUs(); ++i) cpus.push_back(i);
+	}
+	return cpus;
+}
+
+int availableCpus(){
+	int cpus = (int)affinityCpus().size();
+	int quota = cgroupCpuQuota();
+	if(quota > 0){
+		cpus = std::min(cpus, quota);
+	}
+	return std::max(1, cpus);
+}
+
+static void pinTo(const std::vector<int>& cpus){
+	if(cpus.empty()) return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(int c : cpus) CPU_SET(c, &set);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0){
+		LOG_F(WARNING, "pthread_setaffinity_np Failed");
+	}
+}
+
+const ThreadBudget& applyThreadBudget(const Settings& s){
+	budget.total = s.cpuBudget > 0 ? s.cpuBudget : availableCpus();
+	/*
+	 * inference + post-processing + io never exceed total: inference keeps at least one core,
+	 * io and post-processing get what is left (0 -> they share the inference cores)
+	 */
+	int inference = s.inferThreads > 0 ? std::min(s.inferThreads, budget.total) : 1;
+	int rest = budget.total - inference;
+	budget.io = std::min(s.ioThreads > 0 ? s.ioThreads : std::max(1, budget.total / 8), rest);
+	rest -= budget.io;
+	budget.postprocess = std::min(s.postThreads > 0 ? s.postThreads : std::max(1, budget.total / 8), rest);
+	rest -= budget.postprocess;
+	budget.inference = s.inferThreads > 0 ? inference : inference + rest;
+	if(s.inferThreads > budget.total || s.ioThreads > budget.io || s.postThreads > budget.postprocess){
+		LOG_F(WARNING, "Thread Budget: inferThreads %d / postThreads %d / ioThreads %d do not fit in %d cpus, clamped",
+				s.inferThreads, s.postThreads, s.ioThreads, budget.total);
+	}
+	budget.pin = s.pinThreads;
+
+	if(budget.pin){
+		/* Hand out cores in order: inference, post-processing, I/O; wrap around when oversubscribed */
+		std::vector<int> cpus = affinityCpus();
+		int next = 0;
+		int counts[3] = {budget.inference, budget.postprocess, budget.io};
+		for(int stage = 0; stage < 3; ++stage){
+			budget.cpus[stage].clear();
+			for(int i = 0; i < counts[stage]; ++i){
+				budget.cpus[stage].push_back(cpus[next++ % cpus.size()]);
+			}
+		}
+		/* A stage without cores of its own runs on the inference cores */
+		for(int stage = STAGE_POSTPROCESS; stage <= STAGE_IO; ++stage){
+			if(budget.cpus[stage].empty()) budget.cpus[stage] = budget.cpus[STAGE_INFERENCE];
+		}
+		/* OpenCV creates its worker pool lazily from this thread, the workers inherit the mask */
+		pinTo(budget.cpus[STAGE_INFERENCE]);
+	}
+
+	cv::setNumThreads(budget.inference);
+	LOG_F(INFO, "Thread Budget: %d cpus | inference: %d | post-process: %d | io: %d | pinned: %s",
+			budget.total, budget.inference, budget.postprocess, budget.io, budget.pin ? "yes" : "no");
+	return budget;
+}
+
+const ThreadBudget& threadBudget(){
+	return budget;
+}
+
+void pinThread(ThreadStage stage){
+	if(budget.pin){
+		pinTo(budget.cpus[stage]);
+	}
+}
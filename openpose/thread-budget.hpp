@@ -0,0 +1,51 @@
+#ifndef __THREAD_BUDGET__H__
+#define __THREAD_BUDGET__H__
+
+#include "../include/settings.hpp"
+
+#include<vector>
+
+enum ThreadStage{
+	STAGE_INFERENCE=0,
+	STAGE_POSTPROCESS,
+	STAGE_IO
+};
+
+/**
+ * @brief 各个阶段分到的核数, 以及 (pinThreads 时) 分到的 CPU 编号
+ */
+struct ThreadBudget{
+	int total;
+	int inference;
+	int postprocess;
+	int io;
+	bool pin;
+	std::vector<int> cpus[3]; 	// index: ThreadStage
+};
+
+/**
+ * @brief 进程实际可用的核数: affinity mask 与 cgroup CPU quota 取小
+ * @return int
+ */
+int availableCpus();
+
+/**
+ * @brief 按设置切分核数 (inference + postprocess + io <= total), 设置 cv::setNumThreads, pinThreads 时把当前线程绑到推理核上
+ * 	需要在 initNet 之前, 且在创建其他线程之前调用
+ * @param s
+ * @return ThreadBudget
+ */
+const ThreadBudget& applyThreadBudget(const Settings& s);
+
+/**
+ * @brief applyThreadBudget 得到的结果
+ */
+const ThreadBudget& threadBudget();
+
+/**
+ * @brief 当前线程属于哪个阶段; pinThreads 时绑定到该阶段的核上, 否则什么都不做
+ * @param stage
+ */
+void pinThread(ThreadStage stage);
+
+#endif
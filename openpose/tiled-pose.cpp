@@ -0,0 +1,113 @@
+#include "tiled-pose.hpp"
+#include "coarse-to-fine.hpp"
+#include "trace.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+
+void tileSpans(int length, int tileSize, int overlap, std::vector<int>& start, std::vector<int>& coreStart){
+	start.clear();
+	coreStart.clear();
+	if(length <= tileSize){
+		start.push_back(0);
+	}else{
+		/* Evenly spread, so every overlap is at least the requested one */
+		int step = tileSize - overlap;
+		int nTiles = (length - overlap + step - 1) / step;
+		for(int i = 0; i < nTiles;++i){
+			start.push_back((int)((int64_t)(length - tileSize) * i / (nTiles - 1)));
+		}
+	}
+	coreStart.push_back(0);
+	for(size_t i = 1; i < start.size();++i){
+		int overlapBegin = start[i];
+		int overlapEnd = std::min(length, start[i - 1] + tileSize);
+		coreStart.push_back((overlapBegin + overlapEnd) / 2);
+	}
+	coreStart.push_back(length);
+}
+
+void keepCore(const PoseResult& tile, const cv::Rect& core, PoseResult& kept){
+	const CandidateTable& candidates = tile.candidates;
+	std::vector<bool> keepCandidate(candidates.size(), false);
+	std::vector<bool> assigned(candidates.size(), false);
+	std::vector<bool> keepPerson(tile.personwiseKeypoints.size(), false);
+
+	for(size_t n = 0; n < tile.personwiseKeypoints.size();++n){
+		const std::vector<int>& person = tile.personwiseKeypoints[n];
+		cv::Point2d centroid(0, 0);
+		int nParts = 0;
+		for(int id : person){
+			if(id == -1) continue;
+			assigned[id] = true;
+			centroid += cv::Point2d(candidates.x[id], candidates.y[id]);
+			++nParts;
+		}
+		if(nParts == 0) continue;
+		centroid /= nParts;
+		if(centroid.x >= core.x && centroid.x < core.x + core.width && centroid.y >= core.y && centroid.y < core.y + core.height){
+			keepPerson[n] = true;
+			for(int id : person){
+				if(id != -1) keepCandidate[id] = true;
+			}
+		}
+	}
+	for(int id = 0; id < candidates.size();++id){
+		if(!assigned[id] && core.contains(candidates.point(id))){
+			keepCandidate[id] = true;
+		}
+	}
+
+	std::vector<int> newId(candidates.size(), -1);
+	kept.candidates.reset(0);
+	for(int i = 0; i < candidates.nParts();++i){
+		kept.candidates.beginPart();
+		for(int id = candidates.begin(i); id < candidates.end(i);++id){
+			if(keepCandidate[id]){
+				newId[id] = kept.candidates.push(candidates.point(id), candidates.score[id]);
+			}
+		}
+	}
+	for(size_t n = 0; n < tile.personwiseKeypoints.size();++n){
+		if(!keepPerson[n]) continue;
+		std::vector<int> renumbered(tile.personwiseKeypoints[n]);
+		for(int& id : renumbered){
+			if(id != -1) id = newId[id];
+		}
+		kept.personwiseKeypoints.push_back(renumbered);
+	}
+}
+
+void tiledPose(cv::dnn::Net& net, const cv::Mat& input, const Settings& s, PoseResult& result){
+	TRACE_SCOPE("tiledPose");
+	result.candidates.reset(s.nPoints);
+
+	std::vector<int> xStart, xCore, yStart, yCore;
+	tileSpans(input.cols, s.tileSize, s.tileOverlap, xStart, xCore);
+	tileSpans(input.rows, s.tileSize, s.tileOverlap, yStart, yCore);
+	LOG_F(1, "Tiled: %zu x %zu Tiles of %d (Overlap %d)", xStart.size(), yStart.size(), s.tileSize, s.tileOverlap);
+
+	/* One tile at a time: the blob and the resized heatMaps never exceed a tile */
+	for(size_t ty = 0; ty < yStart.size();++ty){
+		for(size_t tx = 0; tx < xStart.size();++tx){
+			cv::Rect tileRect(xStart[tx], yStart[ty], std::min(s.tileSize, input.cols), std::min(s.tileSize, input.rows));
+			cv::Mat tile = input(tileRect);
+
+			PoseResult tileResult;
+			if(s.twoPass){
+				twoPassPose(net, tile, s, tileResult);
+			}else{
+				/* A tile is not a frame, it is never recorded */
+				cv::Mat netOutputBlob = forwardBlob(net, cv::dnn::blobFromImage(tile, s.scale, netInputSize(tile.size(), s), cv::Scalar(0, 0, 0), false, false),
+						{}, "tileForward");
+				postProcess(netOutputBlob, tile.size(), tileResult);
+			}
+
+			cv::Rect core(cv::Point(xCore[tx], yCore[ty]), cv::Point(xCore[tx + 1], yCore[ty + 1]));
+			PoseResult kept;
+			keepCore(tileResult, core - tileRect.tl(), kept);
+			mergePoseResult(result, kept, tileRect.tl());
+		}
+	}
+	LOG_F(1, "Tiled: %zu People", result.personwiseKeypoints.size());
+}
@@ -0,0 +1,43 @@
+#ifndef __TILED_POSE__H__
+#define __TILED_POSE__H__
+
+#include "multi-person-openpose.hpp"
+
+#include<opencv2/dnn.hpp>
+
+#include<vector>
+
+/**
+ * @brief 一个方向上的 tile 划分
+ * 	tile i 覆盖 [start[i], start[i] + tileSize), 相邻的 tile 至少重叠 overlap
+ * 	core i 是 [coreStart[i], coreStart[i+1]), 所有 core 正好铺满 [0, length)
+ *  	(边界取重叠部分的中点)
+ * @param length 	-> 图片的宽或高
+ * @param tileSize
+ * @param overlap
+ * @param start 	-> 返回值
+ * @param coreStart 	-> 返回值 (start.size() + 1 个)
+ */
+void tileSpans(int length, int tileSize, int overlap, std::vector<int>& start, std::vector<int>& coreStart);
+
+/**
+ * @brief 只保留重心落在 core 里的人, 以及 core 里没有归属的候选点
+ * 	重叠区域里的人会被两个 tile 都检测到, 这样每个人只保留一次
+ * @param tile 	-> 一个 tile 的结果 (tile 坐标)
+ * @param core 	-> core 区域 (tile 坐标)
+ * @param kept 	-> 返回值 (tile 坐标)
+ */
+void keepCore(const PoseResult& tile, const cv::Rect& core, PoseResult& kept);
+
+/**
+ * @brief 大图分块推理: 按 tileSize 切成相互重叠 tileOverlap 的块, 逐块推理和后处理,
+ * 	结果合并回原图坐标; 峰值内存只和 tileSize 有关, 与原图大小无关
+ * 	twoPass 时每个块内部再做 coarse-to-fine
+ * @param net
+ * @param input
+ * @param s 	-> tileSize, tileOverlap
+ * @param result 	-> 返回值
+ */
+void tiledPose(cv::dnn::Net& net, const cv::Mat& input, const Settings& s, PoseResult& result);
+
+#endif
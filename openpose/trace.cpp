@@ -0,0 +1,215 @@
+#include "trace.hpp"
+#include "thread-budget.hpp"
+#include "../logsrc/loguru.hpp"
+
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+#include<pthread.h>
+#include<signal.h>
+#include<sys/syscall.h>
+#include<unistd.h>
+
+struct TraceEvent{
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+/*
+ * One buffer per thread, written only by its owner:
+ * the slot is filled first, then head is published with release,
+ * so a dump that reads head with acquire sees complete events.
+ * Buffers are never freed. When a dump finds a finished thread's buffer it moves
+ * the events to traceRetained (written by every later dump) and marks it DRAINED,
+ * a new thread then takes the buffer over,
+ * so short lived threads (one per server connection) do not add a buffer each.
+ */
+enum TraceBufferState{
+	TRACE_ACTIVE=0,
+	TRACE_RETIRED, 	// owner exited, events not dumped yet
+	TRACE_DRAINED 	// owner exited, events moved to traceRetained, free for reuse
+};
+
+struct TraceBuffer{
+	std::vector<TraceEvent> events;
+	uint64_t mask;
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> start; 	// head when the current owner took the buffer
+	std::atomic<int> state;
+	std::atomic<long> tid;
+	TraceBuffer* next;
+};
+
+/* Retires the buffer when its thread exits */
+struct TraceBufferOwner{
+	TraceBuffer* buffer = nullptr;
+	~TraceBufferOwner(){
+		if(buffer != nullptr){
+			buffer->state.store(TRACE_RETIRED, std::memory_order_release);
+		}
+	}
+};
+
+std::atomic<bool> traceOn(false);
+static size_t traceCapacity = 0;
+static std::string tracePath;
+static std::atomic<TraceBuffer*> traceBuffers(nullptr);
+
+/* Events of finished threads, guarded by traceDumpMutex (which also keeps the SIGUSR1 and atexit dumps apart) */
+struct RetainedEvent{
+	TraceEvent event;
+	long tid;
+};
+static std::mutex traceDumpMutex;
+static std::vector<RetainedEvent> traceRetained;
+
+static TraceBuffer* threadBuffer(){
+	thread_local TraceBufferOwner owner;
+	if(owner.buffer != nullptr){
+		return owner.buffer;
+	}
+	/* Reuse a drained buffer; head keeps counting so a concurrent dump still detects overwrites */
+	for(TraceBuffer* buffer = traceBuffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next){
+		int drained = TRACE_DRAINED;
+		if(buffer->state.compare_exchange_strong(drained, TRACE_ACTIVE, std::memory_order_acq_rel)){
+			buffer->tid.store(syscall(SYS_gettid), std::memory_order_relaxed);
+			buffer->start.store(buffer->head.load(std::memory_order_relaxed), std::memory_order_release);
+			owner.buffer = buffer;
+			return buffer;
+		}
+	}
+	TraceBuffer* buffer = new TraceBuffer();
+	buffer->events.resize(traceCapacity);
+	buffer->mask = traceCapacity - 1;
+	buffer->head.store(0);
+	buffer->start.store(0);
+	buffer->state.store(TRACE_ACTIVE);
+	buffer->tid.store(syscall(SYS_gettid));
+	/* Lock-free push onto the list of buffers */
+	buffer->next = traceBuffers.load(std::memory_order_relaxed);
+	while(!traceBuffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed));
+	owner.buffer = buffer;
+	return buffer;
+}
+
+uint64_t traceNow(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void traceRecord(const char* name, uint64_t begin, uint64_t end){
+	TraceBuffer* buffer = threadBuffer();
+	uint64_t head = buffer->head.load(std::memory_order_relaxed);
+	buffer->events[head & buffer->mask] = TraceEvent{name, begin, end};
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+static void traceWrite(FILE* f, const TraceEvent& e, long tid, bool& first){
+	fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f}",
+			first ? "" : ",\n", e.name, (int)getpid(), tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+	first = false;
+}
+
+bool traceDump(const std::string& path){
+	std::lock_guard<std::mutex> lock(traceDumpMutex);
+	FILE* f = fopen(path.c_str(), "w");
+	if(f == nullptr){
+		LOG_F(ERROR, "Could not open trace file '%s'", path.c_str());
+		return false;
+	}
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	size_t total = 0;
+	for(const RetainedEvent& r : traceRetained){
+		traceWrite(f, r.event, r.tid, first);
+		++total;
+	}
+	for(TraceBuffer* buffer = traceBuffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next){
+		int state = buffer->state.load(std::memory_order_acquire);
+		if(state == TRACE_DRAINED) continue; 	// events are in traceRetained
+		long tid = buffer->tid.load(std::memory_order_relaxed);
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t begin = std::max(head > traceCapacity ? head - traceCapacity : 0, buffer->start.load(std::memory_order_acquire));
+		std::vector<TraceEvent> copy;
+		for(uint64_t i = begin; i < head; ++i){
+			copy.push_back(buffer->events[i & buffer->mask]);
+		}
+		/* Slots the owner overwrote while we were copying are dropped */
+		uint64_t after = buffer->head.load(std::memory_order_acquire);
+		uint64_t valid = after > traceCapacity ? after - traceCapacity : 0;
+		for(uint64_t i = std::max(begin, valid); i < head; ++i){
+			traceWrite(f, copy[i - begin], tid, first);
+			++total;
+		}
+		/* The owner is gone: keep its events for every later dump, then hand the buffer to a new thread */
+		if(state == TRACE_RETIRED){
+			for(uint64_t i = std::max(begin, valid); i < head; ++i){
+				traceRetained.push_back(RetainedEvent{copy[i - begin], tid});
+			}
+			buffer->state.compare_exchange_strong(state, TRACE_DRAINED, std::memory_order_acq_rel);
+		}
+	}
+	fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(f);
+	LOG_F(INFO, "Trace: %zu events written to '%s'", total, path.c_str());
+	return true;
+}
+
+static void traceDumpAtExit(){
+	traceDump(tracePath);
+}
+
+static std::mutex signalMutex;
+static std::vector<void (*)()> signalHandlers;
+
+/* SIGUSR1 is blocked here (and inherited by every later thread), one thread waits for it */
+static void startSignalThread(){
+	static std::once_flag started;
+	std::call_once(started, []{
+		sigset_t set;
+		sigemptyset(&set);
+		sigaddset(&set, SIGUSR1);
+		pthread_sigmask(SIG_BLOCK, &set, nullptr);
+		std::thread([set]{
+			int sig;
+			while(sigwait(&set, &sig) == 0){
+				/* Started before the thread budget exists, moved to the I/O cores once it does */
+				pinThread(STAGE_IO);
+				if(traceOn.load()){
+					traceDump(tracePath);
+				}
+				std::vector<void (*)()> handlers;
+				{
+					std::lock_guard<std::mutex> lock(signalMutex);
+					handlers = signalHandlers;
+				}
+				for(void (*handler)() : handlers){
+					handler();
+				}
+			}
+		}).detach();
+	});
+}
+
+void traceOnSignal(void (*handler)()){
+	{
+		std::lock_guard<std::mutex> lock(signalMutex);
+		signalHandlers.push_back(handler);
+	}
+	startSignalThread();
+}
+
+void traceEnable(size_t capacity, const std::string& path){
+	traceCapacity = 1;
+	while(traceCapacity < capacity) traceCapacity <<= 1;
+	tracePath = path;
+	traceOn.store(true);
+	std::atexit(traceDumpAtExit);
+	startSignalThread();
+	LOG_F(INFO, "Trace Enabled: %zu events per thread, 'kill -USR1 %d' to dump to '%s'", traceCapacity, (int)getpid(), path.c_str());
+}
@@ -0,0 +1,67 @@
+#ifndef __TRACE__H__
+#define __TRACE__H__
+
+#include<atomic>
+#include<cstdint>
+#include<string>
+
+/*
+ * 轻量的 trace: 每个线程一个环形 buffer (只有本线程写, 无锁),
+ * 记录各阶段的开始 / 结束时间 (ns), 导出为 Chrome trace / Perfetto 的 JSON.
+ * 	TRACE_SCOPE("forward"); 	-> 记录当前作用域
+ * 名字必须是字符串常量 (只保存指针).
+ */
+
+extern std::atomic<bool> traceOn;
+
+/**
+ * @brief 打开 trace
+ * 	退出时以及收到 SIGUSR1 时写入 path
+ * 	需要在创建其他线程之前调用 (SIGUSR1 要在所有线程中屏蔽)
+ * @param capacity 	-> 每个线程最多保留的事件数 (取 2 的幂)
+ * @param path 		-> JSON 输出路径
+ */
+void traceEnable(size_t capacity, const std::string& path);
+
+/**
+ * @brief 收到 SIGUSR1 时 (在 trace 的信号线程中, trace dump 之后) 调用 handler
+ * 	和 traceEnable 一样需要在创建其他线程之前调用
+ * @param handler 	-> e.g. layerProfileReport
+ */
+void traceOnSignal(void (*handler)());
+
+/**
+ * @brief 单调时钟, ns
+ */
+uint64_t traceNow();
+
+/**
+ * @brief 记录一个事件 (当前线程)
+ */
+void traceRecord(const char* name, uint64_t begin, uint64_t end);
+
+/**
+ * @brief 把所有线程的事件写成 Chrome trace JSON
+ * @param path
+ * @return 是否成功
+ */
+bool traceDump(const std::string& path);
+
+class TraceScope{
+	public:
+		explicit TraceScope(const char* name):name(name),begin(traceOn.load(std::memory_order_relaxed) ? traceNow() : 0){}
+		~TraceScope(){
+			if(begin != 0){
+				traceRecord(name, begin, traceNow());
+			}
+		}
+	private:
+		const char* name;
+		uint64_t begin;
+};
+
+#define TRACE_CONCAT_(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT_(a,b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope,__LINE__)(name)
+
+#endif